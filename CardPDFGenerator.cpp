@@ -4,15 +4,176 @@
 
 #include "CardPDFGenerator.h"
 
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include "ThreadPool.h"
+#include "build_state.h"
+#include "card_utils.h"
+#include "imposition.h"
 
-CardPDFGenerator::CardPDFGenerator(const CardPDFGenerator::Settings &settings) : settings_(settings) {
+// Images are written through libharu's object layer, which is only exposed by static builds
+#ifdef HPDF_SHARED
+#error "CardPDFGenerator requires libharu's object API (build libharu as a static library)"
+#endif
+
+// Adds a card slot whose bleed starts at (baseX, baseY). The image sits inside the bleed
+// and the border, which is drawn by the page overlay
+static void addSlot(LayoutPlan &plan, float baseX, float baseY, float imageWidth, float imageHeight,
+                    float bleed, float border, bool rotated, bool hasBorder) {
+    plan.frontSlots.push_back({baseX + bleed + border, baseY + bleed + border, imageWidth, imageHeight, rotated});
+    if (hasBorder) {
+        plan.borders.push_back({baseX + bleed + (border / 2), baseY + bleed + (border / 2),
+                                imageWidth + border, imageHeight + border});
+    }
+}
+
+// Places the backs behind their fronts: mirrored across the axis the sheet is turned
+// around, then moved by the calibration offset. A card's top edge must stay along its
+// front's, so backs that the turn would point the other way are drawn upside down
+static void planBacks(LayoutPlan &plan, const CardPDFGenerator::Settings &settings) {
+    using DuplexMode = CardPDFGenerator::DuplexMode;
+    bool portrait = plan.pageHeight >= plan.pageWidth;
+    bool flipsAcross = settings.duplexMode != DuplexMode::None &&
+                       (settings.duplexMode == DuplexMode::LongEdge) == portrait; // around a vertical axis
+    bool flipsDown = settings.duplexMode != DuplexMode::None && !flipsAcross;   // around a horizontal axis
+    float dx = settings.backOffsetX * 72.0f / 25.4f;
+    float dy = settings.backOffsetY * 72.0f / 25.4f;
+
+    auto mapX = [&](float x) { return (flipsAcross ? plan.pageWidth - x : x) + dx; };
+    auto mapY = [&](float y) { return (flipsDown ? plan.pageHeight - y : y) + dy; };
+    auto mapRect = [&](LayoutPlan::Rect rect) {
+        float x = flipsAcross ? plan.pageWidth - rect.x - rect.width : rect.x;
+        float y = flipsDown ? plan.pageHeight - rect.y - rect.height : rect.y;
+        rect.x = x + dx;
+        rect.y = y + dy;
+        // Turning the sheet reverses the card's top edge if it runs across the flip axis
+        if (rect.rotated ? flipsAcross : flipsDown) {
+            rect.upsideDown = !rect.upsideDown;
+        }
+        return rect;
+    };
+
+    plan.backSlots.clear();
+    for (const auto &slot: plan.frontSlots) {
+        plan.backSlots.push_back(mapRect(slot));
+    }
+    plan.backBorders.clear();
+    for (const auto &border: plan.borders) {
+        plan.backBorders.push_back(mapRect(border));
+    }
+    plan.backGuideLines.clear();
+    for (const auto &line: plan.guideLines) {
+        plan.backGuideLines.push_back({mapX(line.x0), mapY(line.y0), mapX(line.x1), mapY(line.y1)});
+    }
+    plan.backRotation = settings.backRotation;
+}
+
+static bool samePlan(const LayoutPlan &a, const LayoutPlan &b) {
+    auto sameRect = [](const LayoutPlan::Rect &r, const LayoutPlan::Rect &s) {
+        return r.x == s.x && r.y == s.y && r.width == s.width && r.height == s.height && r.rotated == s.rotated &&
+               r.upsideDown == s.upsideDown;
+    };
+    auto sameLine = [](const LayoutPlan::Line &l, const LayoutPlan::Line &m) {
+        return l.x0 == m.x0 && l.y0 == m.y0 && l.x1 == m.x1 && l.y1 == m.y1;
+    };
+    return std::equal(a.frontSlots.begin(), a.frontSlots.end(), b.frontSlots.begin(), b.frontSlots.end(), sameRect) &&
+           std::equal(a.guideLines.begin(), a.guideLines.end(), b.guideLines.begin(), b.guideLines.end(), sameLine);
+}
+
+// Maps an image's unit square onto a card slot, turned the way the slot asks
+static std::array<float, 6> slotMatrix(const LayoutPlan::Rect &slot) {
+    if (slot.rotated && !slot.upsideDown) {
+        // Turned 90 degrees counterclockwise: the image's width runs up the slot's height,
+        // and its top edge ends up along the slot's left side
+        return {0, slot.height, -slot.width, 0, slot.x + slot.width, slot.y};
+    }
+    if (slot.rotated) {
+        // Turned clockwise: the top edge ends up along the slot's right side
+        return {0, -slot.height, slot.width, 0, slot.x, slot.y + slot.height};
+    }
+    if (slot.upsideDown) {
+        return {-slot.width, 0, 0, -slot.height, slot.x + slot.width, slot.y + slot.height};
+    }
+    return {slot.width, 0, 0, slot.height, slot.x, slot.y};
+}
+
+// The back page calibration rotation, about the page centre
+static std::array<float, 6> backRotationMatrix(const LayoutPlan &plan) {
+    float radians = plan.backRotation * 3.14159265f / 180.0f;
+    float c = std::cos(radians), s = std::sin(radians);
+    float cx = plan.pageWidth / 2, cy = plan.pageHeight / 2;
+    return {c, s, -s, c, cx - (c * cx) + (s * cy), cy - (s * cx) - (c * cy)};
+}
+
+static void appendMatrix(std::string &content, const std::array<float, 6> &m) {
+    char op[128];
+    snprintf(op, sizeof(op), "%.4f %.4f %.4f %.4f %.4f %.4f cm\012", m[0], m[1], m[2], m[3], m[4], m[5]);
+    content += op;
+}
+
+// Whether a file is one of the "name.partN.pdf" files getOutputParts() makes for an output
+static bool isOutputPart(const fs::path &file, const fs::path &output) {
+    std::string name = file.filename().string();
+    std::string prefix = output.stem().string() + ".part";
+    std::string extension = output.extension().string();
+    if (file.parent_path().lexically_normal() != output.parent_path().lexically_normal() ||
+        name.size() <= prefix.size() + extension.size() || !name.starts_with(prefix) || !name.ends_with(extension)) {
+        return false;
+    }
+    return std::all_of(name.begin() + static_cast<std::ptrdiff_t>(prefix.size()),
+                       name.end() - static_cast<std::ptrdiff_t>(extension.size()),
+                       [](unsigned char c) { return std::isdigit(c); });
+}
+
+// The payload is already compressed, so the stream is stored as-is (filter NONE) and the
+// /Filter entry that libharu would otherwise derive from the stream filter is written here.
+static HPDF_STATUS writeFlateFilter(HPDF_Dict /*dict*/, HPDF_Stream stream) {
+    return HPDF_Stream_WriteStr(stream, "/Filter /FlateDecode\012");
+}
+
+// Stores content in a stream dictionary deflated at compressionLevel (or plain at level
+// 0) rather than leaving it to libharu, which only knows its own zlib level
+static void writeContent(HPDF_Dict dict, const unsigned char *content, size_t size, int compressionLevel) {
+    std::vector<unsigned char> deflated;
+    if (compressionLevel != 0) {
+        deflated = deflate_bytes(content, size, compressionLevel);
+        content = deflated.data();
+        size = deflated.size();
+        dict->write_fn = writeFlateFilter;
+    }
+    dict->filter = HPDF_STREAM_FILTER_NONE;
+    HPDF_Stream_Write(dict->stream, content, static_cast<HPDF_UINT>(size));
+}
+
+CardPDFGenerator::CardPDFGenerator(const CardPDFGenerator::Settings &settings,
+                                   std::shared_ptr<PreparedImageStore> imageStore)
+    : settings_(settings), imageCache_(settings.dedupeByContent), imageStore_(std::move(imageStore)) {
     pdf_ = HPDF_New(error_handler, nullptr);
     if (!pdf_) throw std::runtime_error("Failed to create PDF object");
+    // libharu's compression stays off: every stream is compressed here at compressionLevel
 
-    HPDF_SetCompressionMode(pdf_, HPDF_COMP_ALL);
+    if (settings_.spoolImages) {
+        spool_ = std::make_unique<ImageSpool>();
+    }
+
+    if (!settings_.diskCachePath.empty()) {
+        diskCache_ = std::make_shared<DiskImageCache>(settings_.diskCachePath,
+                                                      static_cast<std::uint64_t>(std::max(settings_.diskCacheMb, 0)) * 1024 * 1024);
+    }
 
     // Validate settings
     validateSettings();
+    layout_ = planLayout(settings_);
 }
 
 CardPDFGenerator::~CardPDFGenerator() {
@@ -21,8 +182,28 @@ CardPDFGenerator::~CardPDFGenerator() {
 
 void CardPDFGenerator::generatePDF(const std::string &outputPath, const std::string &frontImagesPath,
                                    const std::string &backImagesPath) {
-    std::vector<fs::path> frontImages = getImageFiles(frontImagesPath);
+    cardsDone_ = 0;
+    cardsTotal_ = 0;
+    bytesWritten_ = 0;
+    filesSkipped_ = 0;
+    residentImageBytes_ = 0;
+    peakImageBytes_ = 0;
+    imagesSpooled_ = 0;
+    phase_ = Phase::Scanning;
+    cancelRequested_ = false;
+    // Another run on this generator, possibly a cancelled one, must not leave its pages behind
+    if (documentUsed_) {
+        resetDocument();
+    }
+    documentUsed_ = true;
+    Instrumentation::Scope generateTimer(instrumentation_.get(), "generate");
+    std::optional<Instrumentation::Scope> scanTimer(std::in_place, instrumentation_.get(), "scan");
+
+    std::vector<CardEntry> frontEntries = getCardEntries(frontImagesPath);
+    std::vector<fs::path> frontImages; // one per printed card; copies share the cached image
     std::vector<fs::path> backImages;
+    std::vector<std::pair<float, float>> cardSizes; // mm, one per card
+    expandEntries(frontEntries, frontImages, cardSizes);
 
     if (settings_.backMode != BackMode::NoBack) {
         if (settings_.backMode == BackMode::SameBack) {
@@ -33,76 +214,731 @@ void CardPDFGenerator::generatePDF(const std::string &outputPath, const std::str
                 throw std::runtime_error("Invalid back image path.");
             }
         } else {
-            backImages = getImageFiles(backImagesPath);
+            std::vector<CardEntry> backEntries = getCardEntries(backImagesPath);
             // Validate that we have enough back images
-            if (backImages.size() < frontImages.size()) {
+            if (backEntries.size() < frontEntries.size()) {
                 throw std::runtime_error("Not enough back images for unique backs mode");
             }
+            // Each back is repeated as often as the front it belongs to
+            for (size_t i = 0; i < frontEntries.size(); ++i) {
+                backImages.insert(backImages.end(), frontEntries[i].quantity * settings_.copiesPerCard,
+                                  backEntries[i].imagePath);
+            }
+        }
+    }
+
+    scanTimer.reset();
+
+    PrepareOptions prepareOptions;
+    prepareOptions.hashContents = settings_.dedupeByContent;
+    prepareOptions.maxDpi = settings_.maxImageDpi;
+    // Images are shared by path, not by size, so the largest card sets the resolution kept
+    prepareOptions.targetWidthMm = settings_.cardWidth;
+    prepareOptions.targetHeightMm = settings_.cardHeight;
+    for (const auto &[width, height]: cardSizes) {
+        prepareOptions.targetWidthMm = std::max(prepareOptions.targetWidthMm, width);
+        prepareOptions.targetHeightMm = std::max(prepareOptions.targetHeightMm, height);
+    }
+    prepareOptions.convertToCmyk = settings_.convertToCmyk;
+    prepareOptions.compressionLevel = settings_.compressionLevel;
+    if (settings_.convertToCmyk && !settings_.cmykLutPath.empty()) {
+        prepareOptions.cmykLut = CmykLut::load(settings_.cmykLutPath);
+    }
+
+    cardsTotal_ = frontImages.size();
+    phase_ = Phase::Layout;
+
+    std::vector<Sheet> sheets = getSheets(frontImages, backImages, cardSizes);
+    std::vector<OutputPart> parts = getOutputParts(outputPath, sheets.size());
+    BuildState state;
+    BuildState previous;
+    if (settings_.incremental) {
+        Instrumentation::Scope timer(instrumentation_.get(), "fingerprint");
+        state.settings = getSettingsFingerprint();
+        state.sheets = getSheetFingerprints(frontImages, backImages, sheets);
+        for (const auto &part: parts) {
+            state.files.push_back(part.path);
+        }
+        previous = load_build_state(build_state_path(outputPath));
+
+        // Keep only the files whose sheets changed since the last run (or that are missing)
+        std::erase_if(parts, [&](const OutputPart &part) {
+            bool unchanged = previous.settings == state.settings && fs::exists(part.path) &&
+                             part.lastSheet <= previous.sheets.size() &&
+                             std::equal(state.sheets.begin() + part.firstSheet, state.sheets.begin() + part.lastSheet,
+                                        previous.sheets.begin() + part.firstSheet) &&
+                             // the last file must not have held more sheets than it does now
+                             (part.lastSheet < state.sheets.size() || previous.sheets.size() == state.sheets.size());
+            if (unchanged) {
+                for (size_t sheet = part.firstSheet; sheet < part.lastSheet; ++sheet) {
+                    cardsDone_ += sheets[sheet].cardCount;
+                }
+                filesSkipped_++;
+            }
+            return unchanged;
+        });
+    }
+
+    if (parts.size() == 1) {
+        std::vector<Sheet> partSheets;
+        std::vector<fs::path> partFronts, partBacks;
+        getPartImages(parts[0], sheets, frontImages, backImages, partSheets, partFronts, partBacks);
+        if (settings_.shardSheets > 0 && partSheets.size() > static_cast<size_t>(settings_.shardSheets)) {
+            generateMerged(parts[0].path, partFronts, partBacks, partSheets, prepareOptions);
+        } else {
+            layoutAndSave(parts[0].path, partFronts, partBacks, partSheets, prepareOptions);
+        }
+    } else if (parts.size() > 1) {
+        generateShards(parts, sheets, frontImages, backImages, prepareOptions);
+    }
+
+    if (settings_.incremental) {
+        // Part files of the last run that this one no longer produces (the deck got shorter).
+        // The state file could be stale or edited, so nothing else it lists is deleted
+        for (const auto &file: previous.files) {
+            if (std::find(state.files.begin(), state.files.end(), file) == state.files.end() &&
+                isOutputPart(file, outputPath)) {
+                fs::remove(file);
+            }
+        }
+        save_build_state(build_state_path(outputPath), state);
+    }
+    phase_ = Phase::Done;
+}
+
+std::vector<CardPDFGenerator::Sheet> CardPDFGenerator::planDeck(const std::string &frontImagesPath,
+                                                                std::vector<fs::path> &frontImages) {
+    std::vector<fs::path> backImages;
+    std::vector<std::pair<float, float>> cardSizes;
+    frontImages.clear();
+    expandEntries(getCardEntries(frontImagesPath), frontImages, cardSizes);
+    return getSheets(frontImages, backImages, cardSizes);
+}
+
+void CardPDFGenerator::expandEntries(const std::vector<CardEntry> &entries, std::vector<fs::path> &frontImages,
+                                     std::vector<std::pair<float, float>> &cardSizes) const {
+    for (const auto &entry: entries) {
+        size_t copies = entry.quantity * settings_.copiesPerCard;
+        frontImages.insert(frontImages.end(), copies, entry.imagePath);
+        cardSizes.insert(cardSizes.end(), copies,
+                         {entry.width > 0.0f ? entry.width : settings_.cardWidth,
+                          entry.height > 0.0f ? entry.height : settings_.cardHeight});
+    }
+}
+
+std::vector<CardPDFGenerator::Sheet> CardPDFGenerator::getSheets(std::vector<fs::path> &frontImages,
+                                                                 std::vector<fs::path> &backImages,
+                                                                 const std::vector<std::pair<float, float>> &cardSizes) {
+    std::vector<Sheet> sheets;
+    bool mixed = std::any_of(cardSizes.begin(), cardSizes.end(), [this](const std::pair<float, float> &size) {
+        return size.first != settings_.cardWidth || size.second != settings_.cardHeight;
+    });
+    if (!mixed) {
+        const size_t cardsPerSheet = layout_.slotsPerPage();
+        for (size_t first = 0; first < frontImages.size(); first += cardsPerSheet) {
+            sheets.push_back({&layout_, first, std::min(cardsPerSheet, frontImages.size() - first)});
+        }
+        return sheets;
+    }
+
+    // Convert mm to points (1 point = 1/72 inch, 1 inch = 25.4 mm)
+    auto pt = [](float mm) { return mm * 72.0f / 25.4f; };
+    const float bleed = pt(settings_.bleed);
+    const float border = pt(settings_.borderWidth);
+
+    std::vector<std::pair<float, float>> slotSizes;
+    slotSizes.reserve(cardSizes.size());
+    for (const auto &[width, height]: cardSizes) {
+        slotSizes.emplace_back(pt(width + (2 * settings_.bleed) + (2 * settings_.borderWidth)),
+                               pt(height + (2 * settings_.bleed) + (2 * settings_.borderWidth)));
+    }
+    std::vector<PackedSheet> packed = pack_sheets(layout_.pageWidth, layout_.pageHeight, slotSizes,
+                                                  settings_.autoImpose);
+
+    // Cards are printed in packing order; sheets packed the same way share one plan
+    const bool uniqueBacks = settings_.backMode == BackMode::UniqueBack && !backImages.empty();
+    std::vector<fs::path> fronts, backs;
+    sheetPlans_.clear();
+    for (const auto &packedSheet: packed) {
+        LayoutPlan plan;
+        plan.pageWidth = layout_.pageWidth;
+        plan.pageHeight = layout_.pageHeight;
+        plan.borderWidth = layout_.borderWidth;
+        plan.guideLineWidth = layout_.guideLineWidth;
+        for (const auto &slot: packedSheet.slots) {
+            auto [width, height] = cardSizes[slot.item];
+            addSlot(plan, slot.x, slot.y, pt(slot.rotated ? height : width), pt(slot.rotated ? width : height),
+                    bleed, border, slot.rotated, settings_.hasBorder);
+            fronts.push_back(frontImages[slot.item]);
+            if (uniqueBacks) {
+                backs.push_back(backImages[slot.item]);
+            }
+        }
+        if (settings_.showGuideLines) {
+            for (const auto &cut: packedSheet.cuts) {
+                plan.guideLines.push_back({cut.x0, cut.y0, cut.x1, cut.y1});
+            }
+        }
+        planBacks(plan, settings_);
+
+        auto existing = std::find_if(sheetPlans_.begin(), sheetPlans_.end(), [&plan](const LayoutPlan &other) {
+            return samePlan(plan, other);
+        });
+        const LayoutPlan *sheetPlan = existing != sheetPlans_.end() ? &*existing
+                                                                    : &sheetPlans_.emplace_back(std::move(plan));
+        sheets.push_back({sheetPlan, fronts.size() - packedSheet.slots.size(), packedSheet.slots.size()});
+    }
+
+    frontImages = std::move(fronts);
+    if (uniqueBacks) {
+        backImages = std::move(backs);
+    }
+    return sheets;
+}
+
+std::vector<CardPDFGenerator::OutputPart> CardPDFGenerator::getOutputParts(const std::string &outputPath,
+                                                                           size_t sheetCount) const {
+    size_t sheetsPerFile = static_cast<size_t>(settings_.sheetsPerFile);
+    if (sheetsPerFile == 0 || sheetCount <= sheetsPerFile) {
+        return {OutputPart{outputPath, 0, sheetCount}};
+    }
+
+    size_t partCount = (sheetCount + sheetsPerFile - 1) / sheetsPerFile;
+
+    // Zero-padded part numbers keep the files in order when listed
+    int digits = static_cast<int>(std::to_string(partCount).size());
+    fs::path output(outputPath);
+
+    std::vector<OutputPart> parts;
+    for (size_t index = 0; index < partCount; ++index) {
+        std::string number = std::to_string(index + 1);
+        number.insert(0, digits - number.size(), '0');
+        fs::path partPath = output.parent_path() / (output.stem().string() + ".part" + number +
+                                                    output.extension().string());
+        size_t first = index * sheetsPerFile;
+        parts.push_back(OutputPart{partPath.string(), first, std::min(first + sheetsPerFile, sheetCount)});
+    }
+    return parts;
+}
+
+void CardPDFGenerator::getPartImages(const OutputPart &part, const std::vector<Sheet> &sheets,
+                                     const std::vector<fs::path> &frontImages,
+                                     const std::vector<fs::path> &backImages, std::vector<Sheet> &partSheets,
+                                     std::vector<fs::path> &partFronts, std::vector<fs::path> &partBacks) const {
+    // Sheets hold consecutive cards, so a part's cards are one range
+    size_t firstCard = part.firstSheet < part.lastSheet ? sheets[part.firstSheet].firstCard : 0;
+    size_t lastCard = firstCard;
+    partSheets.clear();
+    for (size_t index = part.firstSheet; index < part.lastSheet; ++index) {
+        Sheet sheet = sheets[index];
+        sheet.firstCard -= firstCard;
+        lastCard += sheet.cardCount;
+        partSheets.push_back(sheet);
+    }
+
+    partFronts.assign(frontImages.begin() + firstCard, frontImages.begin() + lastCard);
+    if (settings_.backMode == BackMode::UniqueBack) {
+        partBacks.assign(backImages.begin() + firstCard, backImages.begin() + lastCard);
+    } else {
+        partBacks = backImages;
+    }
+}
+
+void CardPDFGenerator::generateShards(const std::vector<OutputPart> &parts, const std::vector<Sheet> &sheets,
+                                      const std::vector<fs::path> &frontImages,
+                                      const std::vector<fs::path> &backImages,
+                                      const PrepareOptions &prepareOptions) {
+    // Shards run side by side, so each gets a share of the image preparation threads
+    size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t concurrentShards = std::min(parts.size(), hardwareThreads);
+    Settings shardSettings = settings_;
+    shardSettings.sheetsPerFile = 0;
+    shardSettings.shardSheets = 0; // the parts already use every core
+    shardSettings.incremental = false;
+    shardSettings.diskCachePath.clear(); // shards use this generator's cache
+    if (shardSettings.workerThreads == 0) {
+        shardSettings.workerThreads = static_cast<int>(std::max<size_t>(1, hardwareThreads / concurrentShards));
+    }
+
+    std::vector<std::unique_ptr<CardPDFGenerator>> shards;
+    std::vector<std::future<void>> results;
+    ThreadPool pool(concurrentShards);
+    for (const auto &part: parts) {
+        // The sheets' plans belong to this generator, which outlives the shards
+        std::vector<Sheet> partSheets;
+        std::vector<fs::path> partFronts, partBacks;
+        getPartImages(part, sheets, frontImages, backImages, partSheets, partFronts, partBacks);
+
+        CardPDFGenerator *generator =
+                shards.emplace_back(std::make_unique<CardPDFGenerator>(shardSettings, imageStore_)).get();
+        generator->root_ = this;
+        generator->diskCache_ = diskCache_;
+        generator->instrumentation_ = instrumentation_;
+        results.push_back(pool.submit(
+            [generator, path = part.path, fronts = std::move(partFronts), backs = std::move(partBacks),
+             partSheets = std::move(partSheets), &prepareOptions] {
+                generator->layoutAndSave(path, fronts, backs, partSheets, prepareOptions);
+            }));
+    }
+
+    // Report the first failure; the remaining shards are stopped through the cancel flag
+    std::exception_ptr failure;
+    for (auto &result: results) {
+        try {
+            result.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+                cancelRequested_ = true;
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void CardPDFGenerator::generateMerged(const std::string &outputPath, const std::vector<fs::path> &frontImages,
+                                      const std::vector<fs::path> &backImages, const std::vector<Sheet> &sheets,
+                                      const PrepareOptions &prepareOptions) {
+    const size_t shardSheets = static_cast<size_t>(settings_.shardSheets);
+    const size_t shardCount = (sheets.size() + shardSheets - 1) / shardSheets;
+
+    // Shards run side by side, so each gets a share of the image preparation threads
+    size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t concurrentShards = std::min(shardCount, hardwareThreads);
+    Settings shardSettings = settings_;
+    shardSettings.sheetsPerFile = 0;
+    shardSettings.shardSheets = 0;
+    shardSettings.incremental = false;
+    shardSettings.spoolImages = false; // shards do not embed anything
+    shardSettings.diskCachePath.clear(); // shards use this generator's cache
+    if (shardSettings.workerThreads == 0) {
+        shardSettings.workerThreads = static_cast<int>(std::max<size_t>(1, hardwareThreads / concurrentShards));
+    }
+
+    std::vector<std::unique_ptr<CardPDFGenerator>> shards;
+    std::vector<std::future<std::vector<ShardPage>>> results;
+    ThreadPool pool(concurrentShards);
+    for (size_t first = 0; first < sheets.size(); first += shardSheets) {
+        // The sheets' plans belong to this generator, which outlives the shards
+        std::vector<Sheet> shardSheetList;
+        std::vector<fs::path> shardFronts, shardBacks;
+        getPartImages(OutputPart{outputPath, first, std::min(first + shardSheets, sheets.size())}, sheets,
+                      frontImages, backImages, shardSheetList, shardFronts, shardBacks);
+
+        CardPDFGenerator *generator =
+                shards.emplace_back(std::make_unique<CardPDFGenerator>(shardSettings, imageStore_)).get();
+        generator->root_ = this;
+        generator->diskCache_ = diskCache_;
+        generator->instrumentation_ = instrumentation_;
+        results.push_back(pool.submit(
+            [generator, fronts = std::move(shardFronts), backs = std::move(shardBacks),
+             shardSheetList = std::move(shardSheetList), &prepareOptions] {
+                return generator->layoutShard(fronts, backs, shardSheetList, prepareOptions);
+            }));
+    }
+
+    // Pages go into pdf_ in deck order as the shards finish. An image is embedded the
+    // first time a page uses it and shared by every later page, whichever shard laid
+    // it out. After the first failure the remaining shards are stopped through the
+    // cancel flag and only drained
+    std::exception_ptr failure;
+    for (auto &result: results) {
+        try {
+            std::vector<ShardPage> pages = result.get();
+            if (!failure) {
+                Instrumentation::Scope timer(instrumentation_.get(), "merge");
+                for (const auto &page: pages) {
+                    addShardPage(page);
+                }
+            }
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+                cancelRequested_ = true;
+            }
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    checkCancelled();
+    saveDocument(outputPath);
+}
+
+std::vector<CardPDFGenerator::ShardPage> CardPDFGenerator::layoutShard(const std::vector<fs::path> &frontImages,
+                                                                       const std::vector<fs::path> &backImages,
+                                                                       const std::vector<Sheet> &sheets,
+                                                                       const PrepareOptions &prepareOptions) {
+    ImagePipeline pipeline(getLoadOrder(frontImages, backImages, sheets), prepareOptions,
+                           static_cast<size_t>(std::max(settings_.workerThreads, 0)), imageStore_, diskCache_,
+                           instrumentation_);
+    Instrumentation::Scope layoutTimer(instrumentation_.get(), "layout");
+
+    // The pipeline yields each file once, in order of first use, like loadImage() takes them;
+    // files are told apart the way getLoadOrder() does, so "deck/a.png" and "./deck/a.png" are one
+    std::unordered_map<std::string, std::shared_ptr<const PreparedImage>> prepared;
+    char op[64];
+    auto addCard = [&](ShardPage &page, const fs::path &imagePath, const LayoutPlan::Rect &slot) {
+        std::string key = fs::absolute(imagePath).lexically_normal().string();
+        auto image = prepared.find(key);
+        if (image == prepared.end()) {
+            Instrumentation::Scope timer(instrumentation_.get(), "wait_image");
+            image = prepared.emplace(key, pipeline.next(imagePath)).first;
+        }
+        auto used = std::find_if(page.images.begin(), page.images.end(),
+                                 [&](const auto &entry) { return entry.second == image->second; });
+        auto index = static_cast<size_t>(used - page.images.begin());
+        if (used == page.images.end()) {
+            page.images.emplace_back(imagePath, image->second);
+        }
+
+        // Same operators as addCardToPage()
+        page.content += "q\012";
+        appendMatrix(page.content, slotMatrix(slot));
+        snprintf(op, sizeof(op), "/I%zu Do\012Q\012", index);
+        page.content += op;
+    };
+    auto overlay = [](ShardPage &page) {
+        if (!page.plan->guideLines.empty() || !page.plan->borders.empty()) {
+            page.content += "/O Do\012";
+        }
+    };
+
+    std::vector<ShardPage> pages;
+    for (const auto &sheet: sheets) {
+        const LayoutPlan &plan = *sheet.plan;
+
+        ShardPage front{{}, false, {}, &plan, sheet.cardCount, false};
+        overlay(front);
+        Instrumentation::count(instrumentation_.get(), "cards", sheet.cardCount);
+        for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+            checkCancelled();
+            addCard(front, frontImages[sheet.firstCard + slot], plan.frontSlots[slot]);
+            root_->cardsDone_++;
+        }
+        pages.push_back(std::move(front));
+
+        if (settings_.backMode != BackMode::NoBack) {
+            ShardPage back{{}, false, {}, &plan, sheet.cardCount, true};
+            if (plan.backRotation != 0.0f) {
+                back.content += "q\012";
+                appendMatrix(back.content, backRotationMatrix(plan));
+            }
+            overlay(back);
+            for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+                checkCancelled();
+                const auto &backImage = settings_.backMode == BackMode::SameBack ?
+                                        backImages[0] : backImages[sheet.firstCard + slot];
+                addCard(back, backImage, plan.backSlots[slot]);
+            }
+            if (plan.backRotation != 0.0f) {
+                back.content += "Q\012";
+            }
+            pages.push_back(std::move(back));
+        }
+    }
+
+    // Compressed here rather than by libharu, so it happens on the shards' threads too
+    if (settings_.compressionLevel != 0) {
+        for (auto &page: pages) {
+            std::vector<unsigned char> deflated = deflate_bytes(reinterpret_cast<const unsigned char *>(page.content.data()),
+                                                                page.content.size(), settings_.compressionLevel);
+            page.content.assign(deflated.begin(), deflated.end());
+            page.deflated = true;
+        }
+    }
+    return pages;
+}
+
+void CardPDFGenerator::addShardPage(const ShardPage &shardPage) {
+    HPDF_Page page = HPDF_AddPage(pdf_);
+    setupPage(page);
+    Instrumentation::count(instrumentation_.get(), "pages");
+
+    // The shard wrote the content itself, so the XObjects it names are put into the
+    // page's resources here instead of by libharu's drawing calls
+    HPDF_Dict xobjects = HPDF_Dict_New(pdf_->mmgr);
+    if (HPDF_XObject overlay = getOverlay(*shardPage.plan, shardPage.cardCount, shardPage.back)) {
+        HPDF_Dict_Add(xobjects, "O", overlay);
+    }
+    for (size_t index = 0; index < shardPage.images.size(); ++index) {
+        const auto &[imagePath, prepared] = shardPage.images[index];
+        HPDF_Image image = imageCache_.find(imagePath);
+        if (image) {
+            Instrumentation::count(instrumentation_.get(), "embed_cache_hits");
+        } else {
+            image = embedPrepared(imagePath, *prepared);
+        }
+        std::string name = "I" + std::to_string(index);
+        HPDF_Dict_Add(xobjects, name.c_str(), image);
+    }
+    auto resources = static_cast<HPDF_Dict>(HPDF_Dict_GetItem(page, "Resources", HPDF_OCLASS_DICT));
+    HPDF_Dict_Add(resources, "XObject", xobjects);
+
+    auto contents = static_cast<HPDF_Dict>(HPDF_Dict_GetItem(page, "Contents", HPDF_OCLASS_DICT));
+    contents->filter = HPDF_STREAM_FILTER_NONE;
+    if (shardPage.deflated) {
+        contents->write_fn = writeFlateFilter;
+    }
+    HPDF_Stream_Write(contents->stream, reinterpret_cast<const HPDF_BYTE *>(shardPage.content.data()),
+                      static_cast<HPDF_UINT>(shardPage.content.size()));
+}
+
+void CardPDFGenerator::finishPage(HPDF_Page page) const {
+    // The drawing calls wrote plain operators; swap them for the compressed form
+    auto contents = static_cast<HPDF_Dict>(HPDF_Dict_GetItem(page, "Contents", HPDF_OCLASS_DICT));
+    HPDF_UINT size = HPDF_Stream_Size(contents->stream);
+    std::vector<unsigned char> content(size);
+    HPDF_Stream_Seek(contents->stream, 0, HPDF_SEEK_SET);
+    HPDF_Stream_Read(contents->stream, content.data(), &size);
+    HPDF_MemStream_FreeData(contents->stream);
+    writeContent(contents, content.data(), size, settings_.compressionLevel);
+}
+
+std::uint64_t CardPDFGenerator::getSettingsFingerprint() const {
+    // Everything that changes the output; thread count, spooling and incremental mode do not
+    std::ostringstream fields;
+    fields << std::setprecision(9)
+           << settings_.pageWidth << ' ' << settings_.pageHeight << ' '
+           << settings_.cardWidth << ' ' << settings_.cardHeight << ' ' << settings_.bleed << ' '
+           << settings_.rows << ' ' << settings_.columns << ' ' << settings_.autoImpose << ' '
+           << settings_.hasBorder << ' ' << settings_.borderWidth << ' '
+           << settings_.borderColor.r << ' ' << settings_.borderColor.g << ' ' << settings_.borderColor.b << ' '
+           << settings_.guideLineWidth << ' ' << settings_.showGuideLines << ' '
+           << static_cast<int>(settings_.backMode) << ' ' << static_cast<int>(settings_.duplexMode) << ' '
+           << settings_.backOffsetX << ' ' << settings_.backOffsetY << ' ' << settings_.backRotation << ' '
+           << settings_.dedupeByContent << ' '
+           << settings_.maxImageDpi << ' ' << settings_.convertToCmyk << ' ' << settings_.cmykLutPath << ' '
+           << settings_.copiesPerCard << ' ' << settings_.compressionLevel << ' ' << settings_.sheetsPerFile;
+    if (settings_.convertToCmyk && !settings_.cmykLutPath.empty() && fs::exists(settings_.cmykLutPath)) {
+        ImageFileKey lut = make_image_file_key(settings_.cmykLutPath);
+        fields << ' ' << lut.size << ' ' << lut.modified;
+    }
+    std::string text = fields.str();
+    return hash_bytes(reinterpret_cast<const unsigned char *>(text.data()), text.size());
+}
+
+std::vector<std::uint64_t> CardPDFGenerator::getSheetFingerprints(const std::vector<fs::path> &frontImages,
+                                                                  const std::vector<fs::path> &backImages,
+                                                                  const std::vector<Sheet> &sheets) const {
+    // Copies share a path, so each file is only looked at once
+    std::unordered_map<std::string, std::uint64_t> fileHashes;
+    auto fileHash = [&fileHashes](const fs::path &imagePath) {
+        auto [it, inserted] = fileHashes.try_emplace(imagePath.string(), 0);
+        if (inserted) {
+            ImageFileKey key = make_image_file_key(imagePath);
+            std::uint64_t h = hash_bytes(reinterpret_cast<const unsigned char *>(key.path.data()), key.path.size());
+            h = hash_bytes(reinterpret_cast<const unsigned char *>(&key.size), sizeof(key.size), h);
+            it->second = hash_bytes(reinterpret_cast<const unsigned char *>(&key.modified), sizeof(key.modified), h);
+        }
+        return it->second;
+    };
+
+    std::vector<std::uint64_t> fingerprints;
+    for (const auto &sheet: sheets) {
+        std::uint64_t fingerprint = hash_bytes(nullptr, 0);
+        for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+            size_t card = sheet.firstCard + slot;
+            // Where the card goes matters too: packed sheets change when card sizes do
+            const LayoutPlan::Rect &rect = sheet.plan->frontSlots[slot];
+            const float geometry[] = {rect.x, rect.y, rect.width, rect.height, rect.rotated ? 1.0f : 0.0f};
+            fingerprint = hash_bytes(reinterpret_cast<const unsigned char *>(geometry), sizeof(geometry), fingerprint);
+
+            std::uint64_t front = fileHash(frontImages[card]);
+            fingerprint = hash_bytes(reinterpret_cast<const unsigned char *>(&front), sizeof(front), fingerprint);
+            if (settings_.backMode != BackMode::NoBack) {
+                std::uint64_t back = fileHash(settings_.backMode == BackMode::SameBack ? backImages[0]
+                                                                                       : backImages[card]);
+                fingerprint = hash_bytes(reinterpret_cast<const unsigned char *>(&back), sizeof(back), fingerprint);
+            }
         }
+        fingerprints.push_back(fingerprint);
     }
+    return fingerprints;
+}
+
+void CardPDFGenerator::layoutAndSave(const std::string &outputPath, const std::vector<fs::path> &frontImages,
+                                     const std::vector<fs::path> &backImages, const std::vector<Sheet> &sheets,
+                                     const PrepareOptions &prepareOptions) {
+    // Decode and compress images on worker threads ahead of the page loop;
+    // only embedding them into pdf_ happens on this thread
+    ImagePipeline pipeline(getLoadOrder(frontImages, backImages, sheets), prepareOptions,
+                           static_cast<size_t>(std::max(settings_.workerThreads, 0)), imageStore_, diskCache_,
+                           instrumentation_);
+    std::optional<Instrumentation::Scope> layoutTimer(std::in_place, instrumentation_.get(), "layout");
 
-    size_t currentCard = 0;
-    while (currentCard < frontImages.size()) {
-        // Track the starting card index for this page
-        size_t pageStartIndex = currentCard;
+    for (const auto &sheet: sheets) {
+        const LayoutPlan &plan = *sheet.plan;
 
         // Create front page
         HPDF_Page page = HPDF_AddPage(pdf_);
         setupPage(page);
-        drawGuideLines(page);  // Add guide lines before drawing cards
+        drawOverlay(page, plan, sheet.cardCount, false);  // Add guide lines and borders before drawing cards
+        Instrumentation::count(instrumentation_.get(), "pages");
+        Instrumentation::count(instrumentation_.get(), "cards", sheet.cardCount);
 
         // Add cards to page
-        for (int row = 0; row < settings_.rows && currentCard < frontImages.size(); ++row) {
-            for (int col = 0; col < settings_.columns && currentCard < frontImages.size(); ++col) {
-                addCardToPage(page, frontImages[currentCard], row, col);
-                currentCard++;
-            }
+        for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+            checkCancelled();
+            addCardToPage(page, loadImage(frontImages[sheet.firstCard + slot], pipeline), plan.frontSlots[slot]);
+            root_->cardsDone_++;
         }
+        finishPage(page);
 
         // Create back page if needed
         if (settings_.backMode != BackMode::NoBack) {
             HPDF_Page backPage = HPDF_AddPage(pdf_);
             setupPage(backPage);
-            drawGuideLines(backPage);  // Add guide lines to back page
-
-            // Reset to start of current page for back images
-            size_t backIndex = pageStartIndex;
-
-            for (int row = 0; row < settings_.rows; ++row) {
-                for (int col = 0; col < settings_.columns; ++col) {
-                    // Only process if we haven't exceeded the number of cards
-                    if (backIndex < currentCard) {
-                        const auto &backImage = settings_.backMode == BackMode::SameBack ?
-                                                backImages[0] : backImages[backIndex];
-                        addCardToPage(backPage, backImage, row, col);
-                        backIndex++;
-                    }
-                }
+            // The calibration rotation turns the whole page, lines and cards alike
+            if (plan.backRotation != 0.0f) {
+                auto m = backRotationMatrix(plan);
+                HPDF_Page_GSave(backPage);
+                HPDF_Page_Concat(backPage, m[0], m[1], m[2], m[3], m[4], m[5]);
             }
+            drawOverlay(backPage, plan, sheet.cardCount, true);  // Add guide lines and borders to back page
+            Instrumentation::count(instrumentation_.get(), "pages");
+
+            // Each back goes where the plan puts the back of its front's slot
+            for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+                checkCancelled();
+                const auto &backImage = settings_.backMode == BackMode::SameBack ?
+                                        backImages[0] : backImages[sheet.firstCard + slot];
+                addCardToPage(backPage, loadImage(backImage, pipeline), plan.backSlots[slot]);
+            }
+            if (plan.backRotation != 0.0f) {
+                HPDF_Page_GRestore(backPage);
+            }
+            finishPage(backPage);
         }
     }
 
-    HPDF_SaveToFile(pdf_, outputPath.c_str());
+    checkCancelled();
+    layoutTimer.reset();
+    saveDocument(outputPath);
 }
 
-void CardPDFGenerator::validateSettings() const {
-    float totalCardWidth = settings_.cardWidth + (2 * settings_.bleed) + (2 * settings_.borderWidth);
-    float totalCardHeight = settings_.cardHeight + (2 * settings_.bleed) + (2 * settings_.borderWidth);
+void CardPDFGenerator::saveDocument(const std::string &outputPath) {
+    if (root_ == this) {
+        phase_ = Phase::Saving;
+    }
+    {
+        Instrumentation::Scope timer(instrumentation_.get(), "save");
+        HPDF_SaveToFile(pdf_, outputPath.c_str());
+    }
+    if (instrumentation_) {
+        std::error_code ec;
+        std::uintmax_t size = fs::file_size(outputPath, ec);
+        if (!ec) {
+            Instrumentation::count(instrumentation_.get(), "output_bytes", size);
+        }
+    }
+}
 
-    float totalWidth = totalCardWidth * settings_.columns;
-    float totalHeight = totalCardHeight * settings_.rows;
+CardPDFGenerator::Progress CardPDFGenerator::progress() const {
+    Progress progress;
+    progress.phase = phase_;
+    progress.cardsDone = cardsDone_;
+    progress.cardsTotal = cardsTotal_;
+    progress.bytesWritten = bytesWritten_;
+    progress.bytesTotal = bytesTotal_;
+    progress.filesSkipped = filesSkipped_;
+    progress.peakImageBytes = peakImageBytes_;
+    progress.imagesSpooled = imagesSpooled_;
+    return progress;
+}
+
+void CardPDFGenerator::cancel() {
+    cancelRequested_ = true;
+}
+
+void CardPDFGenerator::setInstrumentation(std::shared_ptr<Instrumentation> instrumentation) {
+    instrumentation_ = std::move(instrumentation);
+}
 
-    // if more than 1 column, don't count the bleed at each side
-    if (settings_.columns > 1) {
-        totalWidth -= (2 * settings_.bleed);
+bool CardPDFGenerator::reserveImageMemory(std::uint64_t size) {
+    if (settings_.memoryBudgetMb <= 0) {
+        addImageMemory(size);
+        return true;
     }
-    // if more than 1 row, don't count the bleed at the bottom and top
-    if (settings_.rows > 1) {
-        totalHeight -= (2 * settings_.bleed);
+
+    const std::uint64_t budget = static_cast<std::uint64_t>(settings_.memoryBudgetMb) * 1024 * 1024;
+    std::uint64_t resident = residentImageBytes_;
+    do {
+        if (resident + size > budget) {
+            return false;
+        }
+    } while (!residentImageBytes_.compare_exchange_weak(resident, resident + size));
+
+    std::uint64_t peak = peakImageBytes_;
+    while (resident + size > peak && !peakImageBytes_.compare_exchange_weak(peak, resident + size)) {}
+    return true;
+}
+
+void CardPDFGenerator::addImageMemory(std::uint64_t size) {
+    std::uint64_t resident = residentImageBytes_ += size;
+    std::uint64_t peak = peakImageBytes_;
+    while (resident > peak && !peakImageBytes_.compare_exchange_weak(peak, resident)) {}
+}
+
+void CardPDFGenerator::resetDocument() {
+    HPDF_NewDoc(pdf_);
+    imageCache_.clear();
+    overlays_.clear();
+    imageWriteStates_.clear();
+    if (spool_) {
+        spool_ = std::make_unique<ImageSpool>();
     }
+}
 
-    if (totalWidth > settings_.pageWidth || totalHeight > settings_.pageHeight) {
-        throw std::runtime_error("Cards don't fit on page with current settings");
+void CardPDFGenerator::checkCancelled() const {
+    if (root_->cancelRequested_) {
+        throw Cancelled();
+    }
+}
+
+void CardPDFGenerator::validateSettings() const {
+    if (settings_.autoImpose) {
+        if (planLayout(settings_).slotsPerPage() == 0) {
+            throw std::runtime_error("Card doesn't fit on page with current settings");
+        }
+    } else {
+        float totalCardWidth = settings_.cardWidth + (2 * settings_.bleed) + (2 * settings_.borderWidth);
+        float totalCardHeight = settings_.cardHeight + (2 * settings_.bleed) + (2 * settings_.borderWidth);
+
+        float totalWidth = totalCardWidth * settings_.columns;
+        float totalHeight = totalCardHeight * settings_.rows;
+
+        // if more than 1 column, don't count the bleed at each side
+        if (settings_.columns > 1) {
+            totalWidth -= (2 * settings_.bleed);
+        }
+        // if more than 1 row, don't count the bleed at the bottom and top
+        if (settings_.rows > 1) {
+            totalHeight -= (2 * settings_.bleed);
+        }
+
+        if (totalWidth > settings_.pageWidth || totalHeight > settings_.pageHeight) {
+            throw std::runtime_error("Cards don't fit on page with current settings");
+        }
+    }
+
+    if (settings_.compressionLevel < -1 || settings_.compressionLevel > 9) {
+        throw std::runtime_error("Compression level must be between -1 and 9");
+    }
+    if (settings_.memoryBudgetMb < 0) {
+        throw std::runtime_error("Memory budget cannot be negative");
+    }
+    if (settings_.sheetsPerFile < 0) {
+        throw std::runtime_error("Sheets per file cannot be negative");
+    }
+    if (settings_.shardSheets < 0) {
+        throw std::runtime_error("Sheets per shard cannot be negative");
+    }
+    if (settings_.copiesPerCard < 1) {
+        throw std::runtime_error("Copies per card must be at least 1");
     }
 }
 
@@ -111,132 +947,422 @@ void CardPDFGenerator::error_handler(HPDF_STATUS error_no, HPDF_STATUS detail_no
                              ", Detail: " + std::to_string(detail_no));
 }
 
-std::vector<fs::path> CardPDFGenerator::getImageFiles(const std::string &dirPath) {
-    std::vector<fs::path> images;
+std::vector<CardPDFGenerator::CardEntry> CardPDFGenerator::getCardEntries(const std::string &dirPath) {
+    std::vector<CardEntry> entries;
     for (const auto &entry: fs::directory_iterator(dirPath)) {
         if (entry.is_regular_file()) {
             std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
             if (ext == ".jpg" || ext == ".jpeg" || ext == ".png") {
-                images.push_back(entry.path());
+                CardEntry card{entry.path(), 1};
+
+                // "name.x4.png" prints four copies
+                std::string suffix = entry.path().stem().extension().string();
+                if (suffix.size() > 2 && suffix[1] == 'x' &&
+                    std::all_of(suffix.begin() + 2, suffix.end(), [](unsigned char c) { return std::isdigit(c); })) {
+                    card.quantity = std::stoi(suffix.substr(2));
+                }
+                entries.push_back(card);
             }
         }
     }
-    return images;
+
+    // Directory order is arbitrary; natural order keeps "card2" before "card10" and pairs
+    // fronts with backs of the same name in UniqueBack mode
+    std::sort(entries.begin(), entries.end(), [](const CardEntry &a, const CardEntry &b) {
+        return natural_less(a.imagePath.filename().string(), b.imagePath.filename().string());
+    });
+
+    fs::path manifestPath = fs::path(dirPath) / "quantities.txt";
+    if (fs::is_regular_file(manifestPath)) {
+        std::ifstream manifest(manifestPath);
+        std::string line;
+        while (std::getline(manifest, line)) {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#') continue;
+
+            size_t separator = line.find('=');
+            if (separator == std::string::npos) {
+                throw std::runtime_error("Invalid line in " + manifestPath.string() + ": " + line);
+            }
+            std::string name = line.substr(0, separator);
+            name.erase(name.find_last_not_of(" \t") + 1);
+
+            // "N" or "N WxH" with the card size in mm
+            std::istringstream fields(line.substr(separator + 1));
+            int quantity = -1;
+            if (!(fields >> quantity) || quantity < 0) {
+                throw std::runtime_error("Invalid quantity in " + manifestPath.string() + ": " + line);
+            }
+            float width = 0.0f, height = 0.0f;
+            std::string size;
+            if (fields >> size) {
+                std::istringstream dimensions(size);
+                char times = 0;
+                std::string rest;
+                if (!(dimensions >> width >> times >> height) || times != 'x' || width <= 0.0f || height <= 0.0f ||
+                    (dimensions >> rest) || (fields >> rest)) {
+                    throw std::runtime_error("Invalid card size in " + manifestPath.string() + ": " + line);
+                }
+            }
+
+            auto card = std::find_if(entries.begin(), entries.end(), [&](const CardEntry &e) {
+                return e.imagePath.filename() == name;
+            });
+            if (card == entries.end()) {
+                throw std::runtime_error(manifestPath.string() + " lists an unknown image: " + name);
+            }
+            card->quantity = quantity;
+            card->width = width;
+            card->height = height;
+        }
+    }
+    return entries;
 }
 
 void CardPDFGenerator::setupPage(HPDF_Page page) const {
-    // Convert mm to points (1 point = 1/72 inch, 1 inch = 25.4 mm)
-    float pageWidthPt = settings_.pageWidth * 72.0f / 25.4f;
-    float pageHeightPt = settings_.pageHeight * 72.0f / 25.4f;
-
     HPDF_Page_SetSize(page, HPDF_PAGE_SIZE_A4, HPDF_PAGE_PORTRAIT);
-    HPDF_Page_SetWidth(page, pageWidthPt);
-    HPDF_Page_SetHeight(page, pageHeightPt);
-}
-
-void CardPDFGenerator::addCardToPage(HPDF_Page page, const fs::path &imagePath, int row, int col) {
-    // Convert all measurements to points
-    float cardWidthPt = settings_.cardWidth * 72.0f / 25.4f;
-    float cardHeightPt = settings_.cardHeight * 72.0f / 25.4f;
-    float bleedPt = settings_.bleed * 72.0f / 25.4f;
-    float borderPt = settings_.borderWidth * 72.0f / 25.4f;
-
-    // Calculate base position using grid start coordinates
-    float baseX = getGridStartX() + (col * getTotalCardWidth());
-    float baseY = getGridStartY() - ((row + 1) * getTotalCardHeight());
-
-    // Load image
-    HPDF_Image image = nullptr;
-    std::string ext = imagePath.extension().string();
-    std::transform(ext.begin(), ext.end(), ext.begin(),
-                   [](unsigned char c){ return std::tolower(c); });
-
-    if (ext == ".jpg" || ext == ".jpeg") {
-        image = HPDF_LoadJpegImageFromFile(pdf_, imagePath.string().c_str());
-    } else if (ext == ".png") {
-        image = HPDF_LoadPngImageFromFile(pdf_, imagePath.string().c_str());
-    } else {
-        throw std::runtime_error("Unsupported image format: " + imagePath.string());
+    HPDF_Page_SetWidth(page, layout_.pageWidth);
+    HPDF_Page_SetHeight(page, layout_.pageHeight);
+}
+
+std::vector<fs::path> CardPDFGenerator::getLoadOrder(const std::vector<fs::path> &frontImages,
+                                                     const std::vector<fs::path> &backImages,
+                                                     const std::vector<Sheet> &sheets) const {
+    std::vector<fs::path> order;
+    std::unordered_set<std::string> seen;
+    auto add = [&](const fs::path &imagePath) {
+        if (seen.insert(fs::absolute(imagePath).lexically_normal().string()).second) {
+            order.push_back(imagePath);
+        }
+    };
+
+    // Mirrors the page loop in layoutAndSave: a page of fronts, then its backs
+    for (const auto &sheet: sheets) {
+        size_t pageStart = sheet.firstCard;
+        size_t pageEnd = sheet.firstCard + sheet.cardCount;
+        for (size_t i = pageStart; i < pageEnd; ++i) {
+            add(frontImages[i]);
+        }
+        if (settings_.backMode != BackMode::NoBack) {
+            for (size_t i = pageStart; i < pageEnd; ++i) {
+                add(settings_.backMode == BackMode::SameBack ? backImages[0] : backImages[i]);
+            }
+        }
     }
+    return order;
+}
 
-    if (!image) {
-        throw std::runtime_error("Failed to load image: " + imagePath.string());
+HPDF_Image CardPDFGenerator::loadImage(const fs::path &imagePath, ImagePipeline &pipeline) {
+    if (HPDF_Image image = imageCache_.find(imagePath)) {
+        Instrumentation::count(instrumentation_.get(), "embed_cache_hits");
+        return image;
     }
 
-    // If border is enabled, draw it first
-    if (settings_.hasBorder) {
-        // Position for border (includes bleed)
-        float borderX = baseX + bleedPt + (borderPt / 2);
-        float borderY = baseY + bleedPt + (borderPt / 2);
-        float borderWidth = cardWidthPt + borderPt;
-        float borderHeight = cardHeightPt + borderPt;
+    std::shared_ptr<const PreparedImage> prepared;
+    {
+        Instrumentation::Scope timer(instrumentation_.get(), "wait_image");
+        prepared = pipeline.next(imagePath);
+    }
+    return embedPrepared(imagePath, *prepared);
+}
 
-        HPDF_Page_SetRGBStroke(page, settings_.borderColor.r, settings_.borderColor.g, settings_.borderColor.b);
-        HPDF_Page_SetLineWidth(page, borderPt);
-        HPDF_Page_Rectangle(page, borderX, borderY, borderWidth, borderHeight);
-        HPDF_Page_Stroke(page);
+HPDF_Image CardPDFGenerator::embedPrepared(const fs::path &imagePath, const PreparedImage &prepared) {
+    if (HPDF_Image image = imageCache_.findByContent(imagePath, prepared.contentHash)) {
+        Instrumentation::count(instrumentation_.get(), "embed_cache_hits");
+        return image;
     }
 
-    // Calculate image position (inside border if it exists)
-    float imageX = baseX + bleedPt + borderPt;
-    float imageY = baseY + bleedPt + borderPt;
+    Instrumentation::Scope timer(instrumentation_.get(), "embed");
+    HPDF_Image image = embedImage(prepared);
+    imageCache_.insert(imagePath, prepared.contentHash, image);
+    Instrumentation::count(instrumentation_.get(), "images_embedded");
+    return image;
+}
 
-    // Draw the image
-    HPDF_Page_DrawImage(page, image, imageX, imageY, cardWidthPt, cardHeightPt);
+// Spooled images are loaded into their stream just before libharu writes them, and every
+// image is released right after, so memory drains as the document is saved. This runs
+// inside HPDF_SaveToFile, so failures are reported as a status (which makes the save fail
+// and reach error_handler once libharu has closed the file) rather than thrown.
+HPDF_STATUS CardPDFGenerator::beforeImageWrite(HPDF_Dict dict) {
+    const auto *state = static_cast<const ImageWriteState *>(dict->attr);
+    if (state->spooled) {
+        state->generator->addImageMemory(state->size);
+        const ImageSpool::Entry &entry = *state->spooled;
+        HPDF_STATUS status = HPDF_OK;
+        bool ok = entry.spool->read(entry, [dict, &status](const unsigned char *data, size_t size) {
+            if (status == HPDF_OK) {
+                status = HPDF_Stream_Write(dict->stream, data, static_cast<HPDF_UINT>(size));
+            }
+        });
+        if (status != HPDF_OK) {
+            return status;
+        }
+        if (!ok) {
+            return HPDF_SetError(dict->error, HPDF_FILE_IO_ERROR, 0);
+        }
+    }
+    return HPDF_OK;
 }
 
-void CardPDFGenerator::drawGuideLines(HPDF_Page page) const {
-    if (!settings_.showGuideLines) return;
+HPDF_STATUS CardPDFGenerator::afterImageWrite(HPDF_Dict dict) {
+    const auto *state = static_cast<const ImageWriteState *>(dict->attr);
+    state->generator->bytesWritten_ += state->size;
+    Instrumentation::count(state->generator->instrumentation_.get(), "image_bytes_written", state->size);
+    HPDF_MemStream_FreeData(dict->stream);
+    state->generator->residentImageBytes_ -= state->size;
+    return HPDF_OK;
+}
 
-    float guideLineWidthPt = settings_.guideLineWidth * 72.0f / 25.4f;
-    float gridStartX = getGridStartX();
-    float gridStartY = getGridStartY();
-    float cardWidthPt = getTotalCardWidth();
-    float cardHeightPt = getTotalCardHeight();
-    float pageWidthPt = settings_.pageWidth * 72.0f / 25.4f;
-    float pageHeightPt = settings_.pageHeight * 72.0f / 25.4f;
+HPDF_Image CardPDFGenerator::embedImage(const PreparedImage &prepared) {
+    HPDF_Image image = HPDF_DictStream_New(pdf_->mmgr, pdf_->xref);
+    if (!image) {
+        throw std::runtime_error("Failed to create image object for " + prepared.sourcePath.string());
+    }
+    image->header.obj_class |= HPDF_OSUBCLASS_XOBJECT;
 
-    HPDF_Page_SetLineWidth(page, guideLineWidthPt);
-    HPDF_Page_SetRGBStroke(page, 0.5, 0.5, 0.5);  // Gray color for guide lines
+    const char *colorSpace = "DeviceRGB";
+    if (prepared.colorSpace == PreparedImage::ColorSpace::Gray) colorSpace = "DeviceGray";
+    else if (prepared.colorSpace == PreparedImage::ColorSpace::CMYK) colorSpace = "DeviceCMYK";
 
-    // Vertical lines
-    for (int col = 0; col <= settings_.columns; col++) {
-        float x = gridStartX + (col * cardWidthPt);
-        // Extended lines beyond the grid
-        HPDF_Page_MoveTo(page, x, 0);
-        HPDF_Page_LineTo(page, x, pageHeightPt);
-        HPDF_Page_Stroke(page);
+    HPDF_Dict_AddName(image, "Type", "XObject");
+    HPDF_Dict_AddName(image, "Subtype", "Image");
+    HPDF_Dict_AddNumber(image, "Width", prepared.width);
+    HPDF_Dict_AddNumber(image, "Height", prepared.height);
+    HPDF_Dict_AddName(image, "ColorSpace", colorSpace);
+    HPDF_Dict_AddNumber(image, "BitsPerComponent", prepared.bitsPerComponent);
+
+    if (prepared.invertedCmyk) {
+        HPDF_Array decode = HPDF_Array_New(pdf_->mmgr);
+        for (int i = 0; i < 4; ++i) {
+            HPDF_Array_AddReal(decode, 1);
+            HPDF_Array_AddReal(decode, 0);
+        }
+        HPDF_Dict_Add(image, "Decode", decode);
     }
 
-    // Horizontal lines
-    for (int row = 0; row <= settings_.rows; row++) {
-        float y = gridStartY - (row * cardHeightPt);
-        // Extended lines beyond the grid
-        HPDF_Page_MoveTo(page, 0, y);
-        HPDF_Page_LineTo(page, pageWidthPt, y);
-        HPDF_Page_Stroke(page);
+    if (prepared.pngPredictors) {
+        HPDF_Dict decodeParms = HPDF_Dict_New(pdf_->mmgr);
+        HPDF_Dict_AddNumber(decodeParms, "Predictor", 15);
+        HPDF_Dict_AddNumber(decodeParms, "Colors", prepared.colorSpace == PreparedImage::ColorSpace::Gray ? 1 : 3);
+        HPDF_Dict_AddNumber(decodeParms, "BitsPerComponent", prepared.bitsPerComponent);
+        HPDF_Dict_AddNumber(decodeParms, "Columns", prepared.width);
+        HPDF_Dict_Add(image, "DecodeParms", decodeParms);
     }
 
-    // Reset stroke color to black for other drawing operations
-    HPDF_Page_SetRGBStroke(page, 0, 0, 0);
+    if (prepared.encoding == PreparedImage::Encoding::DCT) {
+        image->filter = HPDF_STREAM_FILTER_DCT_DECODE;
+    } else {
+        image->filter = HPDF_STREAM_FILTER_NONE;
+        image->write_fn = writeFlateFilter;
+    }
+
+    // Past the memory budget, image data waits in the spool file instead of in pdf_
+    const ImageSpool::Entry *spooled = nullptr;
+    if (settings_.spoolImages || !root_->reserveImageMemory(prepared.payloadSize())) {
+        if (!spool_) {
+            spool_ = std::make_unique<ImageSpool>();
+        }
+        spooled = spool_->append(prepared.payload(), prepared.payloadSize());
+        root_->imagesSpooled_++;
+        Instrumentation::count(instrumentation_.get(), "bytes_spooled", prepared.payloadSize());
+    } else {
+        HPDF_Stream_Write(image->stream, prepared.payload(), static_cast<HPDF_UINT>(prepared.payloadSize()));
+    }
+    image->attr = &imageWriteStates_.emplace_back(ImageWriteState{root_, spooled, prepared.payloadSize()});
+    image->before_write_fn = beforeImageWrite;
+    image->after_write_fn = afterImageWrite;
+    root_->bytesTotal_ += prepared.payloadSize();
+
+    if (prepared.smask) {
+        HPDF_Dict_Add(image, "SMask", embedImage(*prepared.smask));
+    }
+    return image;
+}
+
+void CardPDFGenerator::addCardToPage(HPDF_Page page, HPDF_Image image, const LayoutPlan::Rect &slot) {
+    if (!slot.rotated && !slot.upsideDown) {
+        HPDF_Page_DrawImage(page, image, slot.x, slot.y, slot.width, slot.height);
+        return;
+    }
+
+    auto m = slotMatrix(slot);
+    HPDF_Page_GSave(page);
+    HPDF_Page_Concat(page, m[0], m[1], m[2], m[3], m[4], m[5]);
+    HPDF_Page_ExecuteXObject(page, image);
+    HPDF_Page_GRestore(page);
 }
 
-float CardPDFGenerator::getTotalCardWidth() const {
-    return (settings_.cardWidth + (2 * settings_.bleed) + (2 * settings_.borderWidth)) * 72.0f / 25.4f;
+void CardPDFGenerator::drawOverlay(HPDF_Page page, const LayoutPlan &plan, size_t cardCount, bool back) {
+    if (HPDF_XObject overlay = getOverlay(plan, cardCount, back)) {
+        HPDF_Page_ExecuteXObject(page, overlay);
+    }
 }
 
-float CardPDFGenerator::getTotalCardHeight() const {
-    return (settings_.cardHeight + (2 * settings_.bleed) + (2 * settings_.borderWidth)) * 72.0f / 25.4f;
+HPDF_XObject CardPDFGenerator::getOverlay(const LayoutPlan &plan, size_t cardCount, bool back) {
+    if (plan.guideLines.empty() && plan.borders.empty()) return nullptr;
+
+    auto key = std::make_tuple(&plan, cardCount, back);
+    auto it = overlays_.find(key);
+    if (it == overlays_.end()) {
+        it = overlays_.emplace(key, createOverlay(plan, cardCount, back)).first;
+    }
+    return it->second;
+}
+
+// The overlay is a form XObject whose content stream is written by hand, so every
+// page shares one copy of the guide lines and borders and only references it with Do.
+HPDF_XObject CardPDFGenerator::createOverlay(const LayoutPlan &plan, size_t cardCount, bool back) {
+    HPDF_XObject overlay = HPDF_DictStream_New(pdf_->mmgr, pdf_->xref);
+    if (!overlay) {
+        throw std::runtime_error("Failed to create page overlay object");
+    }
+    overlay->header.obj_class |= HPDF_OSUBCLASS_XOBJECT;
+
+    HPDF_Array bbox = HPDF_Array_New(pdf_->mmgr);
+    HPDF_Array_AddReal(bbox, 0);
+    HPDF_Array_AddReal(bbox, 0);
+    HPDF_Array_AddReal(bbox, plan.pageWidth);
+    HPDF_Array_AddReal(bbox, plan.pageHeight);
+
+    HPDF_Dict_AddName(overlay, "Type", "XObject");
+    HPDF_Dict_AddName(overlay, "Subtype", "Form");
+    HPDF_Dict_Add(overlay, "BBox", bbox);
+    HPDF_Dict_Add(overlay, "Resources", HPDF_Dict_New(pdf_->mmgr));
+
+    const auto &guideLines = back ? plan.backGuideLines : plan.guideLines;
+    const auto &borders = back ? plan.backBorders : plan.borders;
+    std::string content;
+    char op[128];
+
+    if (!guideLines.empty()) {
+        snprintf(op, sizeof(op), "0.5 0.5 0.5 RG\012%.4f w\012", plan.guideLineWidth);  // Gray color for guide lines
+        content += op;
+        for (const auto &line: guideLines) {
+            snprintf(op, sizeof(op), "%.4f %.4f m %.4f %.4f l S\012", line.x0, line.y0, line.x1, line.y1);
+            content += op;
+        }
+    }
+
+    if (!borders.empty()) {
+        snprintf(op, sizeof(op), "%.4f %.4f %.4f RG\012%.4f w\012",
+                 settings_.borderColor.r, settings_.borderColor.g, settings_.borderColor.b, plan.borderWidth);
+        content += op;
+
+        // Borders of the occupied slots only
+        for (size_t slot = 0; slot < cardCount; ++slot) {
+            const auto &border = borders[slot];
+            snprintf(op, sizeof(op), "%.4f %.4f %.4f %.4f re S\012", border.x, border.y, border.width, border.height);
+            content += op;
+        }
+    }
+
+    writeContent(overlay, reinterpret_cast<const unsigned char *>(content.data()), content.size(),
+                 settings_.compressionLevel);
+    return overlay;
 }
 
-float CardPDFGenerator::getGridStartX() const {
-    float pageWidthPt = settings_.pageWidth * 72.0f / 25.4f;
-    float totalGridWidth = getTotalCardWidth() * settings_.columns;
-    return (pageWidthPt - totalGridWidth) / 2;
+const LayoutPlan &CardPDFGenerator::layoutPlan() const {
+    return layout_;
 }
 
-float CardPDFGenerator::getGridStartY() const {
-    float pageHeightPt = settings_.pageHeight * 72.0f / 25.4f;
-    float totalGridHeight = getTotalCardHeight() * settings_.rows;
-    return pageHeightPt - ((pageHeightPt - totalGridHeight) / 2);
+LayoutPlan CardPDFGenerator::planLayout(const Settings &settings) {
+    // Convert mm to points (1 point = 1/72 inch, 1 inch = 25.4 mm)
+    auto pt = [](float mm) { return mm * 72.0f / 25.4f; };
+
+    LayoutPlan plan;
+    plan.pageWidth = pt(settings.pageWidth);
+    plan.pageHeight = pt(settings.pageHeight);
+
+    // A slot holds the card, its border and its bleed
+    float cardWidth = pt(settings.cardWidth);
+    float cardHeight = pt(settings.cardHeight);
+    float bleed = pt(settings.bleed);
+    float border = pt(settings.borderWidth);
+    float slotWidth = pt(settings.cardWidth + (2 * settings.bleed) + (2 * settings.borderWidth));
+    float slotHeight = pt(settings.cardHeight + (2 * settings.bleed) + (2 * settings.borderWidth));
+
+    Imposition imposition;
+    if (settings.autoImpose) {
+        imposition = solve_imposition(plan.pageWidth, plan.pageHeight, slotWidth, slotHeight);
+    } else {
+        imposition.blocks.push_back({settings.rows, settings.columns, false});
+    }
+
+    // Blocks are centred on the page as a group, each one also centred across the group
+    auto blockWidth = [&](const ImpositionBlock &block) {
+        return block.columns * (block.rotated ? slotHeight : slotWidth);
+    };
+    auto blockHeight = [&](const ImpositionBlock &block) {
+        return block.rows * (block.rotated ? slotWidth : slotHeight);
+    };
+    float groupWidth = 0.0f, groupHeight = 0.0f;
+    for (const auto &block: imposition.blocks) {
+        if (imposition.stacked) {
+            groupWidth = std::max(groupWidth, blockWidth(block));
+            groupHeight += blockHeight(block);
+        } else {
+            groupWidth += blockWidth(block);
+            groupHeight = std::max(groupHeight, blockHeight(block));
+        }
+    }
+
+    if (settings.hasBorder) {
+        plan.borderWidth = border;
+    }
+    if (settings.showGuideLines) {
+        plan.guideLineWidth = pt(settings.guideLineWidth);
+    }
+
+    float offsetX = (plan.pageWidth - groupWidth) / 2;
+    float offsetY = plan.pageHeight - ((plan.pageHeight - groupHeight) / 2); // top of the group
+    for (size_t index = 0; index < imposition.blocks.size(); ++index) {
+        const ImpositionBlock &block = imposition.blocks[index];
+        float width = blockWidth(block);
+        float height = blockHeight(block);
+        float gridStartX = imposition.stacked ? (plan.pageWidth - width) / 2 : offsetX;
+        float gridStartY = imposition.stacked ? offsetY : plan.pageHeight - ((plan.pageHeight - height) / 2);
+        float cellWidth = block.rotated ? slotHeight : slotWidth;
+        float cellHeight = block.rotated ? slotWidth : slotHeight;
+        // The image rect on the page; a rotated card is as wide as an upright one is high
+        float imageWidth = block.rotated ? cardHeight : cardWidth;
+        float imageHeight = block.rotated ? cardWidth : cardHeight;
+
+        for (int row = 0; row < block.rows; ++row) {
+            for (int col = 0; col < block.columns; ++col) {
+                float baseX = gridStartX + (col * cellWidth);
+                float baseY = gridStartY - ((row + 1) * cellHeight);
+                addSlot(plan, baseX, baseY, imageWidth, imageHeight, bleed, border, block.rotated, settings.hasBorder);
+            }
+        }
+
+        if (settings.showGuideLines) {
+            // Lines run to the page edges, except where they would cross into the other block
+            bool first = index == 0;
+            bool last = index + 1 == imposition.blocks.size();
+            float top = imposition.stacked && !first ? gridStartY : plan.pageHeight;
+            float bottom = imposition.stacked && !last ? gridStartY - height : 0.0f;
+            float left = !imposition.stacked && !first ? gridStartX : 0.0f;
+            float right = !imposition.stacked && !last ? gridStartX + width : plan.pageWidth;
+
+            // Vertical lines, then horizontal ones; a line shared with the previous block is drawn once
+            for (int col = (!imposition.stacked && !first) ? 1 : 0; col <= block.columns; col++) {
+                float x = gridStartX + (col * cellWidth);
+                plan.guideLines.push_back({x, bottom, x, top});
+            }
+            for (int row = (imposition.stacked && !first) ? 1 : 0; row <= block.rows; row++) {
+                float y = gridStartY - (row * cellHeight);
+                plan.guideLines.push_back({left, y, right, y});
+            }
+        }
+
+        if (imposition.stacked) {
+            offsetY -= height;
+        } else {
+            offsetX += width;
+        }
+    }
+    planBacks(plan, settings);
+    return plan;
 }
@@ -2,11 +2,27 @@
 #define CARD_PDF_GENERATOR_H
 
 #include <hpdf.h>
+#include "DiskImageCache.h"
+#include "ImageCache.h"
+#include "ImagePipeline.h"
+#include "Instrumentation.h"
+#include "LayoutPlan.h"
+#include "ImageSpool.h"
+#include "PreparedImageStore.h"
+#include "image_loader.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <stdexcept>
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <cctype>
+#include <memory>
 
 namespace fs = std::filesystem;
 
@@ -21,6 +37,60 @@ public:
         UniqueBack ///< Each card will have its own unique back image
     };
 
+    /**
+     * @brief How the printer turns the sheet over for the back side
+     *
+     * Backs are placed where they land behind their fronts once the sheet is turned,
+     * with their top edge along the front's top edge.
+     */
+    enum class DuplexMode {
+        LongEdge,  ///< Flipped around the long edge (the usual duplex setting)
+        ShortEdge, ///< Flipped around the short edge
+        None       ///< Backs in the same positions as their fronts
+    };
+
+    /**
+     * @brief A card image and the number of copies to print
+     */
+    struct CardEntry {
+        fs::path imagePath; ///< Image file
+        int quantity = 1;   ///< Number of copies
+        float width = 0.0f;  ///< Card width in mm (0 = Settings::cardWidth)
+        float height = 0.0f; ///< Card height in mm (0 = Settings::cardHeight)
+    };
+
+    /**
+     * @brief Stage of a generatePDF() call
+     */
+    enum class Phase {
+        Idle,     ///< generatePDF() has not been called
+        Scanning, ///< Reading the image directories
+        Layout,   ///< Placing cards on pages
+        Saving,   ///< Writing the PDF file
+        Done      ///< The PDF file has been written
+    };
+
+    /**
+     * @brief Snapshot of generation progress, see progress()
+     */
+    struct Progress {
+        Phase phase = Phase::Idle;
+        size_t cardsDone = 0;          ///< Cards placed so far (front side)
+        size_t cardsTotal = 0;         ///< Cards to place, known once scanning is done
+        std::uint64_t bytesWritten = 0; ///< Image data written to the PDF file so far
+        std::uint64_t bytesTotal = 0;   ///< Image data the PDF file will contain
+        size_t filesSkipped = 0;        ///< Output files left as they were (incremental mode)
+        std::uint64_t peakImageBytes = 0; ///< Most image data held in memory at once
+        size_t imagesSpooled = 0;         ///< Images moved to the spool file (spoolImages or memoryBudgetMb)
+    };
+
+    /**
+     * @brief Thrown by generatePDF() when cancel() was called
+     */
+    struct Cancelled : std::runtime_error {
+        Cancelled() : std::runtime_error("PDF generation cancelled") {}
+    };
+
     /**
      * @brief Settings for PDF generation
      */
@@ -32,6 +102,7 @@ public:
         float bleed = 0.0f;        ///< Bleed area in mm
         int rows = 3;              ///< Number of rows in the grid
         int columns = 3;           ///< Number of columns in the grid
+        bool autoImpose = false;   ///< Ignore rows/columns and fit as many cards per sheet as possible, rotating some if that fits more
         bool hasBorder = false;    ///< Whether to draw borders around cards
         float borderWidth = 0.0f;  ///< Border width in mm
         struct {
@@ -42,15 +113,35 @@ public:
         float guideLineWidth = 0.1f;  ///< Width of cutting guide lines in mm
         bool showGuideLines = true;   ///< Whether to show cutting guide lines
         BackMode backMode = BackMode::NoBack; ///< Mode for handling card backs
+        DuplexMode duplexMode = DuplexMode::LongEdge; ///< How the sheet is turned over for the back pages
+        float backOffsetX = 0.0f;     ///< Back page calibration: shift in mm, right is positive
+        float backOffsetY = 0.0f;     ///< Back page calibration: shift in mm, up is positive
+        float backRotation = 0.0f;    ///< Back page calibration: degrees counterclockwise about the page centre
+        bool dedupeByContent = false; ///< Also reuse embedded images whose file contents are identical
+        int workerThreads = 0;        ///< Threads preparing images (0 = one per hardware thread)
+        bool spoolImages = false;     ///< Keep image data in a temporary file until save (bounded memory)
+        int memoryBudgetMb = 0;       ///< Image data kept in memory until save; the rest is spooled (0 = no limit)
+        float maxImageDpi = 0.0f;     ///< Downsample PNG images above this effective DPI (0 = native resolution)
+        bool convertToCmyk = false;   ///< Embed images as DeviceCMYK
+        std::string cmykLutPath;      ///< RGB to CMYK table file (empty = plain conversion), see CmykLut
+        int copiesPerCard = 1;        ///< Multiplier applied to every card's quantity
+        int compressionLevel = -1;    ///< zlib level for every stream: images, soft masks, page content and overlays (0-9, -1 = zlib default)
+        int sheetsPerFile = 0;        ///< Split the output into files of this many sheets, built in parallel (0 = one file)
+        int shardSheets = 0;          ///< Lay out a file in shards of this many sheets on worker threads, merged into one document (0 = no shards)
+        bool incremental = false;     ///< Only rewrite output files whose images or settings changed since the last run
+        std::string diskCachePath;    ///< Directory keeping prepared images between runs (empty = no disk cache)
+        int diskCacheMb = 2048;       ///< Size limit of the disk cache in MiB
     };
 
     /**
      * @brief Construct a new Card PDF Generator
      * 
      * @param settings Configuration settings for the PDF generator
+     * @param imageStore Optional store of prepared images shared with other generators
      * @throw std::runtime_error if PDF object creation fails
      */
-    explicit CardPDFGenerator(const Settings &settings);
+    explicit CardPDFGenerator(const Settings &settings,
+                              std::shared_ptr<PreparedImageStore> imageStore = nullptr);
 
     /**
      * @brief Destroy the Card PDF Generator
@@ -69,14 +160,161 @@ public:
      * @param frontImagesPath Directory containing front images or path to single image
      * @param backImagesPath Directory containing back images or path to single image (optional)
      * @throw std::runtime_error if PDF generation fails
+     *
+     * With sheetsPerFile set and more cards than fit in one file, the sheets are
+     * written to "name.partN.pdf" files next to outputPath instead, each built by
+     * its own generator on a worker thread.
+     *
+     * With shardSheets set, a file with more sheets than that is laid out in shards
+     * by generators on worker threads, and the shards' pages are merged into the one
+     * document in order, every image embedded once however many shards use it.
+     *
+     * Cards whose size differs from the settings (see getCardEntries()) are packed
+     * onto sheets by pack_sheets() instead of the grid, largest cards first, and the
+     * deck is printed in that order.
+     *
+     * In incremental mode, a fingerprint of every sheet's images (path, size and
+     * modification time) and of the settings is kept in "<outputPath>.buildstate".
+     * Output files whose sheets all match the previous run are left untouched.
      */
     void generatePDF(const std::string &outputPath,
                      const std::string &frontImagesPath,
                      const std::string &backImagesPath = "");
 
+    /**
+     * @brief Get the progress of a running generatePDF() call
+     *
+     * Safe to call from any thread while generatePDF() runs on another.
+     *
+     * @return Progress Current phase and counters
+     */
+    Progress progress() const;
+
+    /**
+     * @brief Ask a running generatePDF() call to stop
+     *
+     * Safe to call from any thread. Generation stops before the next card is
+     * placed and generatePDF() throws Cancelled; once saving has started the
+     * file is written to completion. Each generatePDF() call starts uncancelled,
+     * so the generator can be used again afterwards.
+     */
+    void cancel();
+
+    /**
+     * @brief Record timers and counters of the following generatePDF() calls
+     *
+     * Phases: "generate", "scan", "fingerprint", "layout", "wait_image" (the page
+     * loop waiting for a worker), "embed", "merge" (adding the pages of shards, see
+     * shardSheets), "save", and on the worker threads "hash" and "prepare".
+     * Counters: images prepared and reused from memory or the disk cache, embedded
+     * images and embed cache hits, pages, cards, bytes read from
+     * image files, image bytes written and output file bytes. Several generators may
+     * share one Instrumentation.
+     *
+     * @param instrumentation Where to record, or nullptr to stop recording
+     */
+    void setInstrumentation(std::shared_ptr<Instrumentation> instrumentation);
+
+    /**
+     * @brief Compute the sheet geometry for a set of settings
+     *
+     * Slots fill the grid row by row from the top left; the generator draws every
+     * page from this plan, so previews can use it to show exactly what will be printed.
+     * With autoImpose, the grid comes from solve_imposition() and may combine upright
+     * and rotated cards. Back slots, borders and guide lines are the front ones mirrored
+     * for duplexMode and moved by the back calibration offset.
+     *
+     * @param settings Settings to lay out
+     * @return LayoutPlan Slot rectangles, borders and guide lines in points
+     */
+    static LayoutPlan planLayout(const Settings &settings);
+
+    /**
+     * @brief Get the sheet geometry this generator uses
+     * @return const LayoutPlan& The plan computed from the settings at construction
+     */
+    const LayoutPlan &layoutPlan() const;
+
+    /**
+     * @brief A page of cards (and its back page)
+     */
+    struct Sheet {
+        const LayoutPlan *plan; ///< layout_, or a packed plan in sheetPlans_ for mixed card sizes
+        size_t firstCard;       ///< Index of the card in the plan's first slot
+        size_t cardCount;       ///< Cards on the sheet, filling the plan's first slots
+    };
+
+    /**
+     * @brief Read a deck and divide it into sheets the way generatePDF() prints it
+     *
+     * For previews: only the fronts are read, and nothing is written. The plans the
+     * sheets point to belong to this generator and stay valid until the next call.
+     *
+     * @param frontImagesPath Directory containing front images
+     * @param frontImages Receives the front image of every card, in print order
+     * @return std::vector<Sheet> The sheets, with card indices into frontImages
+     * @throw std::runtime_error if the directory or its quantities.txt cannot be read,
+     * or a card does not fit on the page
+     */
+    std::vector<Sheet> planDeck(const std::string &frontImagesPath, std::vector<fs::path> &frontImages);
+
 private:
+    /**
+     * @brief An output file and the range of sheets it holds
+     */
+    struct OutputPart {
+        std::string path;
+        size_t firstSheet;
+        size_t lastSheet; ///< One past the last sheet
+    };
+
+    /**
+     * @brief A page laid out by a shard, waiting to be added to the merged document
+     */
+    struct ShardPage {
+        std::string content;  ///< Content stream; draws images[i] as /I<i> and the overlay as /O
+        bool deflated;        ///< Whether content is already zlib-compressed
+        std::vector<std::pair<fs::path, std::shared_ptr<const PreparedImage>>> images;
+        const LayoutPlan *plan;
+        size_t cardCount;
+        bool back;
+    };
+
+    /**
+     * @brief Per-image state used by the write hooks while the document is saved
+     */
+    struct ImageWriteState {
+        CardPDFGenerator *generator;
+        const ImageSpool::Entry *spooled; ///< Spooled payload, or nullptr if held by libharu
+        std::uint64_t size;               ///< Payload size in bytes
+    };
+
+
     HPDF_Doc pdf_;
     Settings settings_;
+    LayoutPlan layout_; ///< Sheet geometry, computed once from settings_
+    std::deque<LayoutPlan> sheetPlans_; ///< Distinct packed sheets of a mixed-size deck, shared with shards
+    ImageCache imageCache_; ///< Images already embedded in pdf_
+    std::unique_ptr<ImageSpool> spool_; ///< Image streams waiting for save (spoolImages only)
+    std::shared_ptr<PreparedImageStore> imageStore_; ///< Prepared images shared across documents
+    std::shared_ptr<DiskImageCache> diskCache_;      ///< Prepared images kept across runs (diskCachePath only)
+    std::shared_ptr<Instrumentation> instrumentation_; ///< Timers and counters (optional)
+    std::map<std::tuple<const LayoutPlan *, size_t, bool>, HPDF_XObject> overlays_; ///< Page overlays by plan, number of cards and side
+    std::deque<ImageWriteState> imageWriteStates_; ///< Referenced by the attr of each embedded image
+
+    CardPDFGenerator *root_ = this; ///< Generator whose progress and cancel flag this one shares
+
+    std::atomic<Phase> phase_{Phase::Idle};
+    std::atomic<size_t> cardsDone_{0};
+    std::atomic<size_t> cardsTotal_{0};
+    std::atomic<std::uint64_t> bytesWritten_{0};
+    std::atomic<std::uint64_t> bytesTotal_{0};
+    std::atomic<size_t> filesSkipped_{0};
+    std::atomic<std::uint64_t> residentImageBytes_{0}; ///< Image data held in memory by this job's documents
+    std::atomic<std::uint64_t> peakImageBytes_{0};
+    std::atomic<size_t> imagesSpooled_{0};
+    std::atomic<bool> cancelRequested_{false};
+    bool documentUsed_ = false; ///< pdf_ holds pages or images from an earlier generatePDF() call
 
     /**
      * @brief Validate current settings
@@ -94,12 +332,215 @@ private:
     static void error_handler(HPDF_STATUS error_no, HPDF_STATUS detail_no, void *user_data);
 
     /**
-     * @brief Get list of image files from directory
-     * 
+     * @brief Throw Cancelled if cancel() has been called
+     */
+    void checkCancelled() const;
+
+    /**
+     * @brief Replace pdf_ with an empty document and drop everything embedded in the old one
+     */
+    void resetDocument();
+
+    /**
+     * @brief Account for image data held in memory, if it fits the memory budget
+     *
+     * Called on the root generator, whose counters cover all shards of a job.
+     *
+     * @param size Bytes about to be held
+     * @return bool True if the bytes were counted, false if they would exceed memoryBudgetMb
+     */
+    bool reserveImageMemory(std::uint64_t size);
+
+    /**
+     * @brief Count image data held in memory regardless of the budget
+     *
+     * @param size Bytes now held
+     */
+    void addImageMemory(std::uint64_t size);
+
+    /**
+     * @brief libharu hook run before an image stream is written
+     *
+     * Loads spooled image data into the stream.
+     */
+    static HPDF_STATUS beforeImageWrite(HPDF_Dict dict);
+
+    /**
+     * @brief libharu hook run after an image stream is written
+     *
+     * Counts the written bytes and releases the image data.
+     */
+    static HPDF_STATUS afterImageWrite(HPDF_Dict dict);
+
+    /**
+     * @brief Get the card images in a directory with their quantities
+     *
+     * A card's quantity comes from a "name.xN.ext" filename suffix, or from a
+     * quantities.txt file in the directory with "filename = N" lines (which takes
+     * precedence). Cards without either are printed once. A manifest line may also
+     * give the card's size in mm, as in "filename = N 70x120". Extensions are matched
+     * case-insensitively and the entries are sorted by file name in natural order.
+     *
      * @param dirPath Directory path
-     * @return std::vector<fs::path> List of image file paths
+     * @return std::vector<CardEntry> Card images, quantities and sizes
+     * @throw std::runtime_error if quantities.txt is malformed or names a missing image
+     */
+    static std::vector<CardEntry> getCardEntries(const std::string &dirPath);
+
+    /**
+     * @brief Expand card entries into one front image and size per printed card
+     *
+     * @param entries Cards with their quantities (multiplied by copiesPerCard)
+     * @param frontImages Receives the front images
+     * @param cardSizes Receives the width and height in mm of every card
      */
-    static std::vector<fs::path> getImageFiles(const std::string &dirPath);
+    void expandEntries(const std::vector<CardEntry> &entries, std::vector<fs::path> &frontImages,
+                       std::vector<std::pair<float, float>> &cardSizes) const;
+
+    /**
+     * @brief Divide the deck into sheets
+     *
+     * A deck of cards in the settings' size fills layout_ sheet by sheet. Otherwise the
+     * cards are packed with pack_sheets() and the images are reordered to match.
+     *
+     * @param frontImages Front images, one per card; reordered for mixed sizes
+     * @param backImages Back images; reordered with the fronts in UniqueBack mode (may be empty)
+     * @param cardSizes Width and height in mm of every card
+     * @return std::vector<Sheet> The sheets in print order
+     * @throw std::runtime_error if a card does not fit on the page
+     */
+    std::vector<Sheet> getSheets(std::vector<fs::path> &frontImages, std::vector<fs::path> &backImages,
+                                 const std::vector<std::pair<float, float>> &cardSizes);
+
+    /**
+     * @brief Lay out cards on pages and save the document
+     *
+     * @param outputPath Path where the PDF will be saved
+     * @param frontImages Front images, one per card
+     * @param backImages Back images (a single one for SameBack mode, one per card for UniqueBack)
+     * @param sheets Sheets to print, with card indices into frontImages
+     * @param prepareOptions How images are prepared for embedding
+     */
+    void layoutAndSave(const std::string &outputPath, const std::vector<fs::path> &frontImages,
+                       const std::vector<fs::path> &backImages, const std::vector<Sheet> &sheets,
+                       const PrepareOptions &prepareOptions);
+
+    /**
+     * @brief Get the files the output is written to
+     *
+     * @param outputPath Path passed to generatePDF()
+     * @param sheetCount Number of sheets
+     * @return std::vector<OutputPart> A single part, or one per sheetsPerFile sheets
+     */
+    std::vector<OutputPart> getOutputParts(const std::string &outputPath, size_t sheetCount) const;
+
+    /**
+     * @brief Get the sheets and images of an output part
+     *
+     * @param part The part
+     * @param sheets Sheets of the whole deck
+     * @param frontImages Front images of the whole deck, one per card
+     * @param backImages Back images of the whole deck
+     * @param partSheets Receives the part's sheets, with card indices into partFronts
+     * @param partFronts Receives the part's front images
+     * @param partBacks Receives the part's back images
+     */
+    void getPartImages(const OutputPart &part, const std::vector<Sheet> &sheets,
+                       const std::vector<fs::path> &frontImages, const std::vector<fs::path> &backImages,
+                       std::vector<Sheet> &partSheets, std::vector<fs::path> &partFronts,
+                       std::vector<fs::path> &partBacks) const;
+
+    /**
+     * @brief Build several output parts in parallel
+     *
+     * Every part is a file of its own, built by a separate generator; to build one
+     * file in parallel, see generateMerged().
+     *
+     * @param parts Parts to build
+     * @param sheets Sheets of the whole deck
+     * @param frontImages Front images of the whole deck, one per card
+     * @param backImages Back images of the whole deck
+     * @param prepareOptions How images are prepared for embedding
+     * @throw std::runtime_error with the first part's error if any part fails
+     */
+    void generateShards(const std::vector<OutputPart> &parts, const std::vector<Sheet> &sheets,
+                        const std::vector<fs::path> &frontImages, const std::vector<fs::path> &backImages,
+                        const PrepareOptions &prepareOptions);
+
+    /**
+     * @brief Lay out one file in shards on worker threads and merge them into pdf_
+     *
+     * Each shard is a range of shardSheets sheets laid out by its own generator with
+     * layoutShard(). The shards' pages are added to pdf_ in deck order as they finish,
+     * so the merge runs while later shards are still being laid out.
+     *
+     * @param outputPath Path where the PDF will be saved
+     * @param frontImages Front images, one per card
+     * @param backImages Back images (a single one for SameBack mode, one per card for UniqueBack)
+     * @param sheets Sheets to print, with card indices into frontImages
+     * @param prepareOptions How images are prepared for embedding
+     * @throw std::runtime_error with the first shard's error if any shard fails
+     */
+    void generateMerged(const std::string &outputPath, const std::vector<fs::path> &frontImages,
+                        const std::vector<fs::path> &backImages, const std::vector<Sheet> &sheets,
+                        const PrepareOptions &prepareOptions);
+
+    /**
+     * @brief Prepare a shard's images and write the content of its pages
+     *
+     * Runs on a shard generator and does not touch its document, so shards can run
+     * side by side; see addShardPage() for the other half.
+     *
+     * @param frontImages Front images of the shard, one per card
+     * @param backImages Back images of the shard
+     * @param sheets The shard's sheets, with card indices into frontImages
+     * @param prepareOptions How images are prepared for embedding
+     * @return std::vector<ShardPage> The shard's pages in print order
+     */
+    std::vector<ShardPage> layoutShard(const std::vector<fs::path> &frontImages,
+                                       const std::vector<fs::path> &backImages, const std::vector<Sheet> &sheets,
+                                       const PrepareOptions &prepareOptions);
+
+    /**
+     * @brief Add a page laid out by a shard to pdf_
+     *
+     * @param shardPage The page
+     */
+    void addShardPage(const ShardPage &shardPage);
+
+    /**
+     * @brief Compress a page drawn with libharu's drawing calls at compressionLevel
+     *
+     * Called once the page is complete; nothing may be drawn on it afterwards.
+     *
+     * @param page The page
+     */
+    void finishPage(HPDF_Page page) const;
+
+    /**
+     * @brief Save pdf_ to a file
+     *
+     * @param outputPath Path where the PDF will be saved
+     */
+    void saveDocument(const std::string &outputPath);
+
+    /**
+     * @brief Fingerprint of the settings that affect the output (incremental mode)
+     * @return std::uint64_t The fingerprint
+     */
+    std::uint64_t getSettingsFingerprint() const;
+
+    /**
+     * @brief Fingerprint of each sheet's images and slots (incremental mode)
+     *
+     * @param frontImages Front images, one per card
+     * @param backImages Back images (a single one for SameBack mode)
+     * @param sheets The sheets
+     * @return std::vector<std::uint64_t> One fingerprint per sheet
+     */
+    std::vector<std::uint64_t> getSheetFingerprints(const std::vector<fs::path> &frontImages,
+                                                    const std::vector<fs::path> &backImages,
+                                                    const std::vector<Sheet> &sheets) const;
 
     /**
      * @brief Set up a new page in the PDF
@@ -109,46 +550,88 @@ private:
     void setupPage(HPDF_Page page) const;
 
     /**
-     * @brief Add a card to the page
-     * 
-     * @param page HPDF_Page object to add card to
+     * @brief Get the distinct images in the order the page loop first uses them
+     *
+     * @param frontImages Front images, one per card
+     * @param backImages Back images (a single one for SameBack mode)
+     * @param sheets Sheets in print order
+     * @return std::vector<fs::path> Each image path once, in order of first use
+     */
+    std::vector<fs::path> getLoadOrder(const std::vector<fs::path> &frontImages,
+                                       const std::vector<fs::path> &backImages,
+                                       const std::vector<Sheet> &sheets) const;
+
+    /**
+     * @brief Get the embedded image for a file, embedding it on first use
+     *
      * @param imagePath Path to the image file
-     * @param row Row position in the grid
-     * @param col Column position in the grid
-     * @param isBack Whether this is a back image
+     * @param pipeline Pipeline preparing the images in load order
+     * @return HPDF_Image Image shared by every card that uses this file
+     * @throw std::runtime_error if the image cannot be loaded
      */
-    void addCardToPage(HPDF_Page page,
-                       const fs::path &imagePath,
-                       int row,
-                       int col);
+    HPDF_Image loadImage(const fs::path &imagePath, ImagePipeline &pipeline);
 
     /**
-     * @brief Draw cutting guide lines on the page
-     * @param page HPDF_Page object to draw on
+     * @brief Get the embedded image for a prepared file, embedding it unless a file with
+     * the same contents already was
+     *
+     * @param imagePath Path to the image file
+     * @param prepared The file prepared by prepare_image()
+     * @return HPDF_Image Image shared by every card that uses this file
      */
-    void drawGuideLines(HPDF_Page page) const;
+    HPDF_Image embedPrepared(const fs::path &imagePath, const PreparedImage &prepared);
 
-    // Helper methods for layout calculations
     /**
-     * @brief Get total width of a card including bleed and border
-     * @return float Total card width in mm
+     * @brief Embed a prepared image as an image XObject
+     *
+     * @param prepared Image prepared by prepare_image()
+     * @return HPDF_Image The new image object
      */
-    float getTotalCardWidth() const;  ///< Get total width including bleed and border
+    HPDF_Image embedImage(const PreparedImage &prepared);
+
     /**
-     * @brief Get total height of a card including bleed and border
-     * @return float Total card height in mm
+     * @brief Add a card to the page
+     * 
+     * @param page HPDF_Page object to add card to
+     * @param image Embedded card image
+     * @param slot Rectangle of the card image, from the sheet's plan
+     */
+    void addCardToPage(HPDF_Page page,
+                       HPDF_Image image,
+                       const LayoutPlan::Rect &slot);
+
+    /**
+     * @brief Draw cutting guide lines and card borders on the page
+     *
+     * The lines are drawn once into a form XObject per plan, number of occupied
+     * slots and side, and shared by every page with that many cards.
+     *
+     * @param page HPDF_Page object to draw on
+     * @param plan Geometry of the page
+     * @param cardCount Number of cards on the page
+     * @param back Whether page is a back page (uses the plan's back geometry)
      */
-    float getTotalCardHeight() const; ///< Get total height including bleed and border
+    void drawOverlay(HPDF_Page page, const LayoutPlan &plan, size_t cardCount, bool back);
+
     /**
-     * @brief Get starting X position of the grid
-     * @return float Starting X position in mm
+     * @brief Get the form XObject holding a page's guide lines and borders, creating it on first use
+     *
+     * @param plan Geometry of the page
+     * @param cardCount Number of cards on the page
+     * @param back Whether page is a back page
+     * @return HPDF_XObject The form object, or nullptr if the plan has nothing to draw
      */
-    float getGridStartX() const;      ///< Get starting X position of the grid
+    HPDF_XObject getOverlay(const LayoutPlan &plan, size_t cardCount, bool back);
+
     /**
-     * @brief Get starting Y position of the grid
-     * @return float Starting Y position in mm
+     * @brief Create the form XObject holding a page's guide lines and borders
+     *
+     * @param plan Geometry of the page
+     * @param cardCount Number of occupied slots to draw borders for
+     * @param back Whether to draw the back geometry
+     * @return HPDF_XObject The new form object
      */
-    float getGridStartY() const;      ///< Get starting Y position of the grid
+    HPDF_XObject createOverlay(const LayoutPlan &plan, size_t cardCount, bool back);
 };
 
 #endif // CARD_PDF_GENERATOR_H
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "DiskImageCache.h"
+#include "card_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Entry layout, native byte order (the cache is local to the machine):
+//   "CPIC", format version, then one record per image: the color image first, its
+//   soft mask (if any) right after. A record is the PreparedImage fields followed by
+//   the payload size and the payload bytes.
+constexpr char entryMagic[4] = {'C', 'P', 'I', 'C'};
+constexpr std::uint32_t entryVersion = 1;
+constexpr const char *entryExtension = ".img";
+
+template<typename T>
+void put(std::vector<unsigned char> &out, T value) {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+bool get(const unsigned char *&pos, const unsigned char *end, T &value) {
+    if (static_cast<size_t>(end - pos) < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+bool write_record(std::ofstream &file, const PreparedImage &image) {
+    std::vector<unsigned char> header;
+    put<std::int32_t>(header, image.width);
+    put<std::int32_t>(header, image.height);
+    put<std::int32_t>(header, image.bitsPerComponent);
+    put<std::uint8_t>(header, static_cast<std::uint8_t>(image.colorSpace));
+    put<std::uint8_t>(header, static_cast<std::uint8_t>(image.encoding));
+    put<std::uint8_t>(header, image.invertedCmyk);
+    put<std::uint8_t>(header, image.pngPredictors);
+    put<std::uint8_t>(header, image.smask != nullptr);
+    put<std::uint64_t>(header, image.payloadSize());
+
+    file.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char *>(image.payload()), static_cast<std::streamsize>(image.payloadSize()));
+    return file && (!image.smask || write_record(file, *image.smask));
+}
+
+// The payload is not copied: the image keeps the entry's mapping alive and points into it
+std::shared_ptr<PreparedImage> read_record(const std::shared_ptr<const MappedFile> &entry, const unsigned char *&pos,
+                                           const fs::path &sourcePath) {
+    const unsigned char *end = entry->data() + entry->size();
+    auto image = std::make_shared<PreparedImage>();
+    std::int32_t width, height, bitsPerComponent;
+    std::uint8_t colorSpace, encoding, invertedCmyk, pngPredictors, hasSmask;
+    std::uint64_t payloadSize;
+    if (!get(pos, end, width) || !get(pos, end, height) || !get(pos, end, bitsPerComponent) ||
+        !get(pos, end, colorSpace) || !get(pos, end, encoding) || !get(pos, end, invertedCmyk) ||
+        !get(pos, end, pngPredictors) || !get(pos, end, hasSmask) || !get(pos, end, payloadSize) ||
+        colorSpace > static_cast<std::uint8_t>(PreparedImage::ColorSpace::CMYK) ||
+        encoding > static_cast<std::uint8_t>(PreparedImage::Encoding::Flate) ||
+        payloadSize > static_cast<std::uint64_t>(end - pos)) {
+        return nullptr;
+    }
+
+    image->sourcePath = sourcePath;
+    image->width = width;
+    image->height = height;
+    image->bitsPerComponent = bitsPerComponent;
+    image->colorSpace = static_cast<PreparedImage::ColorSpace>(colorSpace);
+    image->encoding = static_cast<PreparedImage::Encoding>(encoding);
+    image->invertedCmyk = invertedCmyk;
+    image->pngPredictors = pngPredictors;
+    image->mapping = entry;
+    image->mappingOffset = static_cast<size_t>(pos - entry->data());
+    image->mappingSize = static_cast<size_t>(payloadSize);
+    pos += payloadSize;
+
+    if (hasSmask) {
+        image->smask = read_record(entry, pos, sourcePath);
+        if (!image->smask) {
+            return nullptr;
+        }
+    }
+    return image;
+}
+
+// Everything in the options that changes the prepared bytes
+std::uint64_t hash_options(const PrepareOptions &options) {
+    std::vector<unsigned char> fields;
+    put<std::uint32_t>(fields, entryVersion);
+    put<float>(fields, options.maxDpi);
+    if (options.maxDpi > 0.0f) {
+        put<float>(fields, options.targetWidthMm);
+        put<float>(fields, options.targetHeightMm);
+    }
+    put<std::uint8_t>(fields, options.convertToCmyk);
+    put<std::uint64_t>(fields, options.convertToCmyk && options.cmykLut ? options.cmykLut->fingerprint() : 0);
+    put<std::int32_t>(fields, options.compressionLevel);
+    return hash_bytes(fields.data(), fields.size());
+}
+
+std::string to_hex(std::uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, value >>= 4) {
+        hex[i] = digits[value & 0xF];
+    }
+    return hex;
+}
+
+} // namespace
+
+DiskImageCache::DiskImageCache(fs::path directory, std::uint64_t maxBytes)
+    : directory_(std::move(directory)), maxBytes_(maxBytes) {
+    fs::create_directories(directory_);
+
+    std::error_code ec;
+    for (const auto &entry: fs::directory_iterator(directory_, ec)) {
+        if (entry.path().extension() == entryExtension) {
+            bytes_ += entry.file_size(ec);
+        }
+    }
+}
+
+std::shared_ptr<const PreparedImage> DiskImageCache::find(const fs::path &imagePath, std::uint64_t contentHash,
+                                                          const PrepareOptions &options) {
+    fs::path path = entryPath(contentHash, options);
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+        misses_++;
+        return nullptr;
+    }
+
+    std::shared_ptr<PreparedImage> image;
+    try {
+        auto entry = std::make_shared<const MappedFile>(path);
+        const unsigned char *pos = entry->data();
+        const unsigned char *end = pos + entry->size();
+        std::uint32_t version = 0;
+        if (entry->size() >= sizeof(entryMagic) && std::memcmp(pos, entryMagic, sizeof(entryMagic)) == 0) {
+            pos += sizeof(entryMagic);
+            if (get(pos, end, version) && version == entryVersion) {
+                image = read_record(entry, pos, imagePath);
+            }
+        }
+    } catch (const std::exception &) {
+        image = nullptr; // deleted by another process, or unreadable
+    }
+
+    if (!image) {
+        fs::remove(path, ec);
+        misses_++;
+        return nullptr;
+    }
+
+    image->contentHash = options.hashContents ? contentHash : 0;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec); // most recently used
+    hits_++;
+    return image;
+}
+
+void DiskImageCache::insert(std::uint64_t contentHash, const PrepareOptions &options, const PreparedImage &image) {
+    fs::path path = entryPath(contentHash, options);
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+        return;
+    }
+
+    // Written under a unique name and renamed into place, so readers never see a partial entry
+    fs::path temporary = path;
+    temporary += "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(entryMagic, sizeof(entryMagic));
+        file.write(reinterpret_cast<const char *>(&entryVersion), sizeof(entryVersion));
+        if (!file || !write_record(file, image)) {
+            file.close();
+            fs::remove(temporary, ec);
+            return;
+        }
+    }
+
+    std::uintmax_t size = fs::file_size(temporary, ec);
+    fs::rename(temporary, path, ec);
+    if (ec) {
+        fs::remove(temporary, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_ += size;
+    if (bytes_ > maxBytes_) {
+        evict();
+    }
+}
+
+size_t DiskImageCache::hits() const {
+    return hits_;
+}
+
+size_t DiskImageCache::misses() const {
+    return misses_;
+}
+
+fs::path DiskImageCache::entryPath(std::uint64_t contentHash, const PrepareOptions &options) const {
+    return directory_ / (to_hex(contentHash) + "-" + to_hex(hash_options(options)) + entryExtension);
+}
+
+void DiskImageCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        std::uintmax_t size;
+    };
+
+    // Rescan, since other processes may have added or removed entries
+    std::vector<Entry> entries;
+    std::error_code ec;
+    bytes_ = 0;
+    for (const auto &file: fs::directory_iterator(directory_, ec)) {
+        if (file.path().extension() == entryExtension) {
+            Entry entry{file.path(), file.last_write_time(ec), file.file_size(ec)};
+            bytes_ += entry.size;
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for (const auto &entry: entries) {
+        if (bytes_ <= maxBytes_) {
+            break;
+        }
+        if (fs::remove(entry.path, ec)) {
+            bytes_ -= entry.size;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef DISK_IMAGE_CACHE_H
+#define DISK_IMAGE_CACHE_H
+
+#include "image_loader.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Persistent, content-addressed cache of prepared images in a local directory
+ *
+ * Keeps the encoded payloads of prepared images between runs, so a deck that was
+ * generated before only needs its files hashed and the cached payloads mapped instead
+ * of decoding, resampling, converting and compressing every image again. Entries are
+ * keyed by a hash of the source file's contents and of the preparation options, so
+ * renamed or copied files still hit and changed files or settings miss.
+ *
+ * Entries are written atomically (temporary file and rename), so several processes may
+ * share a directory. When the directory grows past its size limit, the least recently
+ * used entries (by modification time, refreshed on every hit) are deleted. Cache
+ * errors never fail generation: an unreadable entry is a miss and a failed write is
+ * skipped.
+ */
+class DiskImageCache {
+public:
+    /**
+     * @brief Open (and create if needed) a cache directory
+     *
+     * @param directory Cache directory
+     * @param maxBytes Maximum total size of the entries
+     * @throw std::filesystem::filesystem_error if the directory cannot be created
+     */
+    DiskImageCache(std::filesystem::path directory, std::uint64_t maxBytes);
+
+    DiskImageCache(const DiskImageCache &) = delete;
+
+    DiskImageCache &operator=(const DiskImageCache &) = delete;
+
+    /**
+     * @brief Look up the prepared version of an image file
+     *
+     * @param imagePath Source file (stored as the image's sourcePath)
+     * @param contentHash hash_file() of the source file
+     * @param options Options the image must have been prepared with
+     * @return std::shared_ptr<const PreparedImage> The image with its payload mapped
+     *         from the cache entry, or nullptr if not cached
+     */
+    std::shared_ptr<const PreparedImage> find(const std::filesystem::path &imagePath, std::uint64_t contentHash,
+                                              const PrepareOptions &options);
+
+    /**
+     * @brief Store a prepared image, evicting old entries if the cache is full
+     *
+     * @param contentHash hash_file() of the source file
+     * @param options Options the image was prepared with
+     * @param image The prepared image
+     */
+    void insert(std::uint64_t contentHash, const PrepareOptions &options, const PreparedImage &image);
+
+    size_t hits() const;   ///< Lookups served from the cache
+    size_t misses() const; ///< Lookups that found nothing
+
+private:
+    std::filesystem::path entryPath(std::uint64_t contentHash, const PrepareOptions &options) const;
+
+    void evict();
+
+    std::filesystem::path directory_;
+    std::uint64_t maxBytes_;
+    std::mutex mutex_;        ///< Guards bytes_ and eviction
+    std::uint64_t bytes_ = 0; ///< Size of the entries, as of the last scan plus inserts since
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+#endif // DISK_IMAGE_CACHE_H
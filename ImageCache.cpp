@@ -0,0 +1,42 @@
+#include "ImageCache.h"
+
+ImageCache::ImageCache(bool matchContents) : matchContents_(matchContents) {}
+
+HPDF_Image ImageCache::find(const fs::path &imagePath) {
+    auto it = byFile_.find(make_image_file_key(imagePath));
+    if (it == byFile_.end()) {
+        return nullptr;
+    }
+    hits_++;
+    return it->second;
+}
+
+HPDF_Image ImageCache::findByContent(const fs::path &imagePath, std::uint64_t contentHash) {
+    if (!matchContents_) {
+        return nullptr;
+    }
+
+    // Same bytes under a different name (e.g. duplicated card files)
+    auto it = byContent_.find(contentHash);
+    if (it == byContent_.end()) {
+        return nullptr;
+    }
+    hits_++;
+    byFile_.emplace(make_image_file_key(imagePath), it->second);
+    return it->second;
+}
+
+void ImageCache::insert(const fs::path &imagePath, std::uint64_t contentHash, HPDF_Image image) {
+    misses_++;
+    byFile_.emplace(make_image_file_key(imagePath), image);
+    if (matchContents_) {
+        byContent_.emplace(contentHash, image);
+    }
+}
+
+void ImageCache::clear() {
+    byFile_.clear();
+    byContent_.clear();
+    hits_ = 0;
+    misses_ = 0;
+}
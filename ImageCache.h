@@ -0,0 +1,76 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <hpdf.h>
+#include "image_loader.h"
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Per-document cache of embedded images
+ *
+ * Maps an image file to the HPDF_Image already embedded in the document, so every
+ * distinct image is decoded and written to the PDF only once. Entries are keyed by
+ * path, file size and modification time. Optionally the file contents are hashed as
+ * well (see PreparedImage::contentHash), so identical files stored under different
+ * names share a single image.
+ */
+class ImageCache {
+public:
+    /**
+     * @brief Construct an empty cache
+     *
+     * @param matchContents Whether to also match images by a hash of their contents
+     */
+    explicit ImageCache(bool matchContents = false);
+
+    /**
+     * @brief Look up the image embedded for a file
+     *
+     * @param imagePath Path to the image file
+     * @return HPDF_Image The cached image, or nullptr if the file has not been embedded yet
+     */
+    HPDF_Image find(const fs::path &imagePath);
+
+    /**
+     * @brief Look up an image embedded from a file with identical contents
+     *
+     * On a hit the file is also registered, so later find() calls for it succeed.
+     *
+     * @param imagePath Path to the image file
+     * @param contentHash Hash of the file contents
+     * @return HPDF_Image The cached image, or nullptr if content matching is off or nothing matches
+     */
+    HPDF_Image findByContent(const fs::path &imagePath, std::uint64_t contentHash);
+
+    /**
+     * @brief Register a newly embedded image
+     *
+     * @param imagePath Path to the image file
+     * @param contentHash Hash of the file contents (ignored unless content matching is on)
+     * @param image The embedded image
+     */
+    void insert(const fs::path &imagePath, std::uint64_t contentHash, HPDF_Image image);
+
+    bool matchesContents() const { return matchContents_; } ///< Whether content hashes are used
+
+    /**
+     * @brief Drop all entries (e.g. when the owning document is freed)
+     */
+    void clear();
+
+    size_t hits() const { return hits_; }     ///< Lookups served from the cache
+    size_t misses() const { return misses_; } ///< Images that had to be embedded
+
+private:
+    std::unordered_map<ImageFileKey, HPDF_Image, ImageFileKeyHash> byFile_;
+    std::unordered_map<std::uint64_t, HPDF_Image> byContent_;
+    bool matchContents_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+#endif // IMAGE_CACHE_H
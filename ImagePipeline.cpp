@@ -0,0 +1,147 @@
+#include "ImagePipeline.h"
+#include "card_utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace {
+
+// Memory store first, then the disk cache, then the actual work. JPEGs are only
+// parsed, which is cheaper than hashing them, so they skip the disk cache unless
+// CMYK conversion has them decoded and re-encoded.
+std::shared_ptr<const PreparedImage> prepare_or_reuse(const fs::path &imagePath, const PrepareOptions &options,
+                                                      size_t deflateThreads, PreparedImageStore *store,
+                                                      DiskImageCache *diskCache, Instrumentation *instrumentation) {
+    ImageFileKey key;
+    if (store) {
+        key = make_image_file_key(imagePath);
+        if (auto cached = store->find(key, options)) {
+            Instrumentation::count(instrumentation, "images_from_memory");
+            return cached;
+        }
+    }
+
+    std::shared_ptr<const PreparedImage> image;
+    std::uint64_t contentHash = 0;
+    std::string ext = imagePath.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    bool useDisk = diskCache && (ext == ".png" || options.convertToCmyk);
+    if (useDisk) {
+        {
+            Instrumentation::Scope timer(instrumentation, "hash");
+            contentHash = hash_file(imagePath);
+        }
+        image = diskCache->find(imagePath, contentHash, options);
+        if (image) {
+            Instrumentation::count(instrumentation, "images_from_disk_cache");
+        }
+    }
+    if (!image) {
+        {
+            Instrumentation::Scope timer(instrumentation, "prepare");
+            image = std::make_shared<const PreparedImage>(prepare_image(imagePath, options, deflateThreads));
+        }
+        Instrumentation::count(instrumentation, "images_prepared");
+        if (useDisk) {
+            diskCache->insert(contentHash, options, *image);
+        }
+    }
+
+    if (instrumentation) {
+        // The file was read once, either to hash it or to prepare it
+        std::error_code ec;
+        std::uintmax_t size = fs::file_size(imagePath, ec);
+        if (!ec) {
+            Instrumentation::count(instrumentation, "bytes_read", size);
+        }
+    }
+
+    if (store) {
+        store->insert(key, options, image);
+    }
+    return image;
+}
+
+} // namespace
+
+ImagePipeline::ImagePipeline(std::vector<fs::path> images, const PrepareOptions &options, size_t threadCount,
+                             std::shared_ptr<PreparedImageStore> store, std::shared_ptr<DiskImageCache> diskCache,
+                             std::shared_ptr<Instrumentation> instrumentation)
+    : pool_(threadCount), images_(std::move(images)), options_(options), store_(std::move(store)),
+      diskCache_(std::move(diskCache)), instrumentation_(std::move(instrumentation)),
+      capacity_(pool_.size() * 2),
+      // With fewer images than workers, the spare threads help compress each image
+      deflateThreads_(std::max<size_t>(1, pool_.size() / std::max<size_t>(1, std::min(pool_.size(), images_.size())))) {
+    if (images_.size() > capacity_) {
+        prefetcher_ = std::thread(&ImagePipeline::prefetchLoop, this);
+    }
+    fill();
+}
+
+ImagePipeline::~ImagePipeline() {
+    if (prefetcher_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex_);
+            stopPrefetch_ = true;
+        }
+        prefetchWake_.notify_one();
+        prefetcher_.join();
+    }
+}
+
+std::shared_ptr<const PreparedImage> ImagePipeline::next(const fs::path &imagePath) {
+    if (inFlight_.empty()) {
+        throw std::logic_error("Image pipeline has no more images (requested " + imagePath.string() + ")");
+    }
+
+    auto [expectedPath, ready] = std::move(inFlight_.front());
+    inFlight_.pop_front();
+    fill(); // keep the workers busy while the caller embeds this one
+
+    if (expectedPath != imagePath) {
+        throw std::logic_error("Image pipeline out of order: expected " + imagePath.string() +
+                               ", queued " + expectedPath.string());
+    }
+    return ready.get();
+}
+
+void ImagePipeline::fill() {
+    while (inFlight_.size() < capacity_ && nextToSubmit_ < images_.size()) {
+        const fs::path &imagePath = images_[nextToSubmit_];
+        inFlight_.emplace_back(imagePath, pool_.submit([imagePath, options = options_,
+                                                        deflateThreads = deflateThreads_, store = store_,
+                                                        diskCache = diskCache_, instrumentation = instrumentation_] {
+            return prepare_or_reuse(imagePath, options, deflateThreads, store.get(), diskCache.get(),
+                                    instrumentation.get());
+        }));
+        nextToSubmit_++;
+    }
+
+    if (prefetcher_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex_);
+            prefetchBegin_ = nextToSubmit_;
+            prefetchEnd_ = std::min(images_.size(), nextToSubmit_ + prefetchDistance);
+        }
+        prefetchWake_.notify_one();
+    }
+}
+
+// images_ is not modified after construction, so it is read here without the lock
+void ImagePipeline::prefetchLoop() {
+    size_t next = 0;
+    std::unique_lock<std::mutex> lock(prefetchMutex_);
+    while (true) {
+        // Files the workers already have are skipped, in case prefetching fell behind
+        prefetchWake_.wait(lock, [&] { return stopPrefetch_ || std::max(next, prefetchBegin_) < prefetchEnd_; });
+        if (stopPrefetch_) {
+            return;
+        }
+        next = std::max(next, prefetchBegin_);
+        const fs::path &imagePath = images_[next++];
+        lock.unlock();
+        prefetch_file(imagePath);
+        lock.lock();
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include "DiskImageCache.h"
+#include "Instrumentation.h"
+#include "PreparedImageStore.h"
+#include "ThreadPool.h"
+#include "image_loader.h"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Prepares images on a thread pool ahead of the thread that writes the PDF
+ *
+ * The images are prepared in the order given at construction, with at most a fixed
+ * number in flight (a bounded queue), so memory stays proportional to the number of
+ * workers rather than to the size of the deck. The consumer takes them back in the
+ * same order with next(). With a PreparedImageStore, images prepared by earlier
+ * pipelines are reused and new ones are added to it; a DiskImageCache does the same
+ * across runs.
+ *
+ * A background thread asks the OS to read ahead the files that come after the queued
+ * ones (see prefetch_file()), so on cold caches and network folders the workers find
+ * them already in memory instead of waiting for the disk.
+ */
+class ImagePipeline {
+public:
+    /**
+     * @brief Start preparing images
+     *
+     * @param images Images in the order they will be consumed
+     * @param options Options passed to prepare_image()
+     * @param threadCount Number of worker threads; 0 uses one per hardware thread
+     * @param store Optional store shared with other pipelines
+     * @param diskCache Optional persistent cache, consulted after the store
+     * @param instrumentation Optional timers and counters for the workers
+     */
+    ImagePipeline(std::vector<fs::path> images, const PrepareOptions &options, size_t threadCount,
+                  std::shared_ptr<PreparedImageStore> store = nullptr,
+                  std::shared_ptr<DiskImageCache> diskCache = nullptr,
+                  std::shared_ptr<Instrumentation> instrumentation = nullptr);
+
+    ~ImagePipeline();
+
+    ImagePipeline(const ImagePipeline &) = delete;
+
+    ImagePipeline &operator=(const ImagePipeline &) = delete;
+
+    /**
+     * @brief Take the next prepared image, waiting for it if necessary
+     *
+     * @param imagePath Path the caller expects next (checked against the queue order)
+     * @return std::shared_ptr<const PreparedImage> The prepared image
+     * @throw std::runtime_error if preparing the image failed
+     * @throw std::logic_error if images are taken out of order
+     */
+    std::shared_ptr<const PreparedImage> next(const fs::path &imagePath);
+
+private:
+    static constexpr size_t prefetchDistance = 32; ///< Files read ahead beyond the queued images
+
+    void fill();
+
+    void prefetchLoop();
+
+    ThreadPool pool_;
+    std::vector<fs::path> images_;
+    PrepareOptions options_;
+    std::shared_ptr<PreparedImageStore> store_;
+    std::shared_ptr<DiskImageCache> diskCache_;
+    std::shared_ptr<Instrumentation> instrumentation_;
+    size_t capacity_;          ///< Maximum number of images queued or being prepared
+    size_t deflateThreads_;    ///< Threads compressing each image, see deflate_bytes()
+    size_t nextToSubmit_ = 0;  ///< Index in images_ of the next image to hand to the pool
+    std::deque<std::pair<fs::path, std::future<std::shared_ptr<const PreparedImage>>>> inFlight_;
+
+    std::thread prefetcher_;
+    std::mutex prefetchMutex_;
+    std::condition_variable prefetchWake_;
+    size_t prefetchBegin_ = 0;   ///< Index in images_ of the first image not yet handed to the pool
+    size_t prefetchEnd_ = 0;     ///< Index in images_ up to which files should be read ahead
+    bool stopPrefetch_ = false;
+};
+
+#endif // IMAGE_PIPELINE_H
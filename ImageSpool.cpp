@@ -0,0 +1,53 @@
+#include "ImageSpool.h"
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+ImageSpool::ImageSpool(const fs::path &directory) {
+    std::random_device random;
+    do {
+        path_ = directory / ("card_pdf_spool_" + std::to_string(random()) + ".tmp");
+    } while (fs::exists(path_));
+
+    file_.open(path_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        throw std::runtime_error("Failed to create image spool file: " + path_.string());
+    }
+}
+
+ImageSpool::~ImageSpool() {
+    file_.close();
+    std::error_code ignored;
+    fs::remove(path_, ignored);
+}
+
+ImageSpool::Entry *ImageSpool::append(const unsigned char *data, std::uint64_t size) {
+    file_.seekp(static_cast<std::streamoff>(size_));
+    file_.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    if (!file_) {
+        throw std::runtime_error("Failed to write image spool file: " + path_.string());
+    }
+
+    entries_.push_back(Entry{this, size_, size});
+    size_ += size;
+    return &entries_.back();
+}
+
+bool ImageSpool::read(const Entry &entry, const std::function<void(const unsigned char *, size_t)> &sink) {
+    std::vector<char> buffer(1 << 16);
+    file_.seekg(static_cast<std::streamoff>(entry.offset));
+
+    std::uint64_t remaining = entry.size;
+    while (remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<std::uint64_t>(remaining, buffer.size()));
+        if (!file_.read(buffer.data(), static_cast<std::streamsize>(chunk))) {
+            file_.clear();
+            return false;
+        }
+        sink(reinterpret_cast<const unsigned char *>(buffer.data()), chunk);
+        remaining -= chunk;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef IMAGE_SPOOL_H
+#define IMAGE_SPOOL_H
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Temporary file holding image streams until the PDF is saved
+ *
+ * libharu keeps every stream in memory until HPDF_SaveToFile. Spooling the image
+ * payloads instead means only one of them needs to be resident at a time, while the
+ * document is being written. The file is deleted when the spool is destroyed.
+ */
+class ImageSpool {
+public:
+    /**
+     * @brief Location of one spooled stream
+     */
+    struct Entry {
+        ImageSpool *spool;     ///< Spool holding the bytes
+        std::uint64_t offset;  ///< Offset in the spool file
+        std::uint64_t size;    ///< Number of bytes
+    };
+
+    /**
+     * @brief Create an empty spool file
+     *
+     * @param directory Directory for the temporary file
+     * @throw std::runtime_error if the file cannot be created
+     */
+    explicit ImageSpool(const fs::path &directory = fs::temp_directory_path());
+
+    ~ImageSpool();
+
+    ImageSpool(const ImageSpool &) = delete;
+
+    ImageSpool &operator=(const ImageSpool &) = delete;
+
+    /**
+     * @brief Append a stream to the spool
+     *
+     * @param data Stream bytes
+     * @param size Number of bytes
+     * @return Entry* Location of the stream; stays valid for the spool's lifetime
+     * @throw std::runtime_error if writing fails
+     */
+    Entry *append(const unsigned char *data, std::uint64_t size);
+
+    /**
+     * @brief Read a spooled stream back in chunks
+     *
+     * @param entry Stream to read
+     * @param sink Called with each chunk in order
+     * @return bool False if reading failed
+     */
+    bool read(const Entry &entry, const std::function<void(const unsigned char *, size_t)> &sink);
+
+    std::uint64_t size() const { return size_; } ///< Total bytes spooled
+
+private:
+    fs::path path_;
+    std::fstream file_;
+    std::deque<Entry> entries_;
+    std::uint64_t size_ = 0;
+};
+
+#endif // IMAGE_SPOOL_H
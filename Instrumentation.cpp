@@ -0,0 +1,106 @@
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+void write_file(const std::filesystem::path &path, const std::string &text) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+}
+
+} // namespace
+
+Instrumentation::Instrumentation() : origin_(Clock::now()) {}
+
+void Instrumentation::count(Instrumentation *target, const char *counter, std::uint64_t value) {
+    if (!target) return;
+    std::lock_guard<std::mutex> lock(target->mutex_);
+    target->counters_[counter] += value;
+}
+
+void Instrumentation::record(const char *phase, Clock::time_point start, Clock::time_point end) {
+    using std::chrono::duration;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    double seconds = duration<double>(end - start).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    PhaseTotals &totals = phases_[phase];
+    totals.calls++;
+    totals.seconds += seconds;
+    totals.maxSeconds = std::max(totals.maxSeconds, seconds);
+
+    auto [thread, inserted] = threads_.try_emplace(std::this_thread::get_id(), static_cast<int>(threads_.size()) + 1);
+    events_.push_back(Event{phase, thread->second, duration_cast<microseconds>(start - origin_).count(),
+                            duration_cast<microseconds>(end - start).count()});
+}
+
+std::map<std::string, Instrumentation::PhaseTotals> Instrumentation::phases() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return phases_;
+}
+
+std::map<std::string, std::uint64_t> Instrumentation::counters() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counters_;
+}
+
+// Phase and counter names are identifiers chosen in the code, so they need no escaping
+std::string Instrumentation::toJson() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream json;
+    json << "{\n  \"phases\": {";
+    const char *separator = "\n";
+    for (const auto &[name, totals]: phases_) {
+        json << separator << "    \"" << name << "\": {\"calls\": " << totals.calls
+             << ", \"seconds\": " << totals.seconds << ", \"maxSeconds\": " << totals.maxSeconds << "}";
+        separator = ",\n";
+    }
+    json << "\n  },\n  \"counters\": {";
+    separator = "\n";
+    for (const auto &[name, value]: counters_) {
+        json << separator << "    \"" << name << "\": " << value;
+        separator = ",\n";
+    }
+    json << "\n  }\n}\n";
+    return json.str();
+}
+
+std::string Instrumentation::toChromeTrace() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream json;
+    json << "{\"traceEvents\": [";
+    const char *separator = "\n";
+    for (const Event &event: events_) {
+        json << separator << "{\"name\": \"" << event.phase << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+             << event.thread << ", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs << "}";
+        separator = ",\n";
+    }
+    // Counters as one sample at the end, shown as counter tracks
+    std::int64_t end = 0;
+    for (const Event &event: events_) {
+        end = std::max(end, event.startUs + event.durationUs);
+    }
+    for (const auto &[name, value]: counters_) {
+        json << separator << "{\"name\": \"" << name << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << end
+             << ", \"args\": {\"value\": " << value << "}}";
+        separator = ",\n";
+    }
+    json << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return json.str();
+}
+
+void Instrumentation::writeJson(const std::filesystem::path &path) const {
+    write_file(path, toJson());
+}
+
+void Instrumentation::writeChromeTrace(const std::filesystem::path &path) const {
+    write_file(path, toChromeTrace());
+}
@@ -0,0 +1,131 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Timers and counters collected while generating a PDF
+ *
+ * Timed phases ("scan", "prepare", "embed", "save", ...) are aggregated by name and
+ * also kept as individual events, so a run can be summarized as JSON or inspected on
+ * a timeline as a Chrome trace (chrome://tracing or https://ui.perfetto.dev). Phases
+ * nest: the time of "layout" includes the "wait_image" and "embed" phases inside it.
+ *
+ * All methods are thread-safe. Everything that records takes a possibly null pointer,
+ * so instrumentation costs nothing when it is not enabled.
+ */
+class Instrumentation {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Times the enclosing block as one occurrence of a phase
+     */
+    class Scope {
+    public:
+        /**
+         * @param target Where to record, or nullptr to record nothing
+         * @param phase Phase name; must outlive the Instrumentation (a string literal)
+         */
+        Scope(Instrumentation *target, const char *phase)
+            : target_(target), phase_(phase), start_(target ? Clock::now() : Clock::time_point{}) {}
+
+        ~Scope() {
+            if (target_) target_->record(phase_, start_, Clock::now());
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Instrumentation *target_;
+        const char *phase_;
+        Clock::time_point start_;
+    };
+
+    /**
+     * @brief Aggregate of one phase
+     */
+    struct PhaseTotals {
+        std::uint64_t calls = 0;
+        double seconds = 0.0;    ///< Total time, summed over threads
+        double maxSeconds = 0.0; ///< Longest single occurrence
+    };
+
+    Instrumentation();
+
+    Instrumentation(const Instrumentation &) = delete;
+
+    Instrumentation &operator=(const Instrumentation &) = delete;
+
+    /**
+     * @brief Add to a counter
+     *
+     * @param target Where to count, or nullptr to count nothing
+     * @param counter Counter name
+     * @param value Amount to add
+     */
+    static void count(Instrumentation *target, const char *counter, std::uint64_t value = 1);
+
+    /**
+     * @brief Record one occurrence of a phase
+     *
+     * @param phase Phase name; must outlive the Instrumentation (a string literal)
+     * @param start When it started
+     * @param end When it ended
+     */
+    void record(const char *phase, Clock::time_point start, Clock::time_point end);
+
+    std::map<std::string, PhaseTotals> phases() const;        ///< Totals by phase name
+    std::map<std::string, std::uint64_t> counters() const;    ///< Counters by name
+
+    /**
+     * @brief Phase totals and counters as a JSON object
+     * @return std::string {"phases": {name: {calls, seconds, maxSeconds}}, "counters": {name: value}}
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Every recorded phase occurrence in Chrome trace event format
+     * @return std::string A JSON object with a "traceEvents" array of complete ("X") events
+     */
+    std::string toChromeTrace() const;
+
+    /**
+     * @brief Write toJson() to a file
+     * @throw std::runtime_error if the file cannot be written
+     */
+    void writeJson(const std::filesystem::path &path) const;
+
+    /**
+     * @brief Write toChromeTrace() to a file
+     * @throw std::runtime_error if the file cannot be written
+     */
+    void writeChromeTrace(const std::filesystem::path &path) const;
+
+private:
+    struct Event {
+        const char *phase;
+        int thread;
+        std::int64_t startUs; ///< Since origin_
+        std::int64_t durationUs;
+    };
+
+    Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::map<std::string, PhaseTotals> phases_;
+    std::map<std::string, std::uint64_t> counters_;
+    std::vector<Event> events_;
+    std::unordered_map<std::thread::id, int> threads_; ///< Small trace thread ids, in order of first event
+};
+
+#endif // INSTRUMENTATION_H
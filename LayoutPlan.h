@@ -0,0 +1,42 @@
+#ifndef LAYOUT_PLAN_H
+#define LAYOUT_PLAN_H
+
+#include <cstddef>
+#include <vector>
+
+// Geometry of a sheet, in PDF points with the origin at the bottom-left corner of the
+// page. Computed once from the settings (see CardPDFGenerator::planLayout) and then
+// only iterated when pages are written, so the PDF and any preview agree.
+struct LayoutPlan {
+    struct Rect {
+        float x = 0.0f;      // left edge
+        float y = 0.0f;      // bottom edge
+        float width = 0.0f;
+        float height = 0.0f;
+        bool rotated = false; // card image turned 90 degrees counterclockwise to fill the rect
+        bool upsideDown = false; // turned a further 180 degrees (a back lining up with its front's top edge)
+    };
+
+    struct Line {
+        float x0, y0, x1, y1;
+    };
+
+    float pageWidth = 0.0f;
+    float pageHeight = 0.0f;
+
+    std::vector<Rect> frontSlots;   // card images in the order cards fill a page (rect on the page)
+    std::vector<Rect> backSlots;    // where the back of frontSlots[i] goes on the back page
+    std::vector<Rect> borders;      // border of frontSlots[i], stroked along its centre line
+    std::vector<Line> guideLines;   // cutting guides, empty if disabled
+    std::vector<Rect> backBorders;  // borders as placed on the back page
+    std::vector<Line> backGuideLines; // guideLines as placed on the back page
+
+    float backRotation = 0.0f;      // degrees counterclockwise about the page centre, applied to whole back pages
+
+    float borderWidth = 0.0f;       // 0 if borders are disabled
+    float guideLineWidth = 0.0f;
+
+    size_t slotsPerPage() const { return frontSlots.size(); }
+};
+
+#endif // LAYOUT_PLAN_H
@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map empty or unreadable file: " + path.string());
+    }
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+
+    mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // the mapping keeps the file open
+    if (!mapping_) {
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+
+    data_ = static_cast<const unsigned char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        CloseHandle(mapping_);
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot map empty or unreadable file: " + path.string());
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    void *address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (address == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+
+    // Images are read front to back exactly once
+    madvise(address, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const unsigned char *>(address);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <filesystem>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ *
+ * Gives zero-copy access to a file's bytes straight from the page cache. The mapping
+ * is released when the object is destroyed.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Map a file into memory
+     *
+     * @param path File to map
+     * @throw std::runtime_error if the file cannot be opened or mapped, or is empty
+     */
+    explicit MappedFile(const std::filesystem::path &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data() const { return data_; } ///< First byte of the file
+    size_t size() const { return size_; }               ///< File size in bytes
+
+private:
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void *mapping_ = nullptr; ///< File mapping handle
+#endif
+};
+
+#endif // MAPPED_FILE_H
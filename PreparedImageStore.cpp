@@ -0,0 +1,63 @@
+#include "PreparedImageStore.h"
+
+namespace {
+
+std::uint64_t payload_bytes(const PreparedImage &image) {
+    std::uint64_t bytes = image.payloadSize();
+    if (image.smask) {
+        bytes += payload_bytes(*image.smask);
+    }
+    return bytes;
+}
+
+} // namespace
+
+PreparedImageStore::PreparedImageStore(std::uint64_t maxBytes) : maxBytes_(maxBytes) {}
+
+std::shared_ptr<const PreparedImage> PreparedImageStore::find(const ImageFileKey &key, const PrepareOptions &options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end() || !(it->second->options == options)) {
+        misses_++;
+        return nullptr;
+    }
+    hits_++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->image;
+}
+
+void PreparedImageStore::insert(const ImageFileKey &key, const PrepareOptions &options,
+                                std::shared_ptr<const PreparedImage> image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = index_.find(key);
+    if (existing != index_.end()) {
+        bytes_ -= existing->second->bytes;
+        entries_.erase(existing->second);
+        index_.erase(existing);
+    }
+
+    std::uint64_t bytes = payload_bytes(*image);
+    entries_.push_front(Entry{key, options, std::move(image), bytes});
+    index_.emplace(key, entries_.begin());
+    bytes_ += bytes;
+    evict();
+}
+
+size_t PreparedImageStore::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+size_t PreparedImageStore::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+void PreparedImageStore::evict() {
+    while (bytes_ > maxBytes_ && !entries_.empty()) {
+        const Entry &oldest = entries_.back();
+        bytes_ -= oldest.bytes;
+        index_.erase(oldest.key);
+        entries_.pop_back();
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef PREPARED_IMAGE_STORE_H
+#define PREPARED_IMAGE_STORE_H
+
+#include "image_loader.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @brief Thread-safe, size-limited store of prepared images shared between generators
+ *
+ * Lets several documents built by the same process (e.g. the jobs of a CLI manifest)
+ * reuse prepared images instead of decoding and compressing the same files again.
+ * When the payloads exceed the size limit, the least recently used images are dropped.
+ */
+class PreparedImageStore {
+public:
+    /**
+     * @brief Construct an empty store
+     *
+     * @param maxBytes Maximum total payload size kept in the store
+     */
+    explicit PreparedImageStore(std::uint64_t maxBytes);
+
+    /**
+     * @brief Look up a prepared image
+     *
+     * @param key Version of the source file
+     * @param options Options the image must have been prepared with
+     * @return std::shared_ptr<const PreparedImage> The image, or nullptr if not stored
+     */
+    std::shared_ptr<const PreparedImage> find(const ImageFileKey &key, const PrepareOptions &options);
+
+    /**
+     * @brief Add a prepared image, evicting older ones if the store is full
+     *
+     * @param key Version of the source file
+     * @param options Options the image was prepared with
+     * @param image The prepared image
+     */
+    void insert(const ImageFileKey &key, const PrepareOptions &options, std::shared_ptr<const PreparedImage> image);
+
+    size_t hits() const;   ///< Lookups served from the store
+    size_t misses() const; ///< Lookups that found nothing
+
+private:
+    struct Entry {
+        ImageFileKey key;
+        PrepareOptions options;
+        std::shared_ptr<const PreparedImage> image;
+        std::uint64_t bytes;
+    };
+
+    void evict();
+
+    mutable std::mutex mutex_;
+    std::list<Entry> entries_; ///< Most recently used first
+    std::unordered_map<ImageFileKey, std::list<Entry>::iterator, ImageFileKeyHash> index_;
+    std::uint64_t maxBytes_;
+    std::uint64_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+#endif // PREPARED_IMAGE_STORE_H
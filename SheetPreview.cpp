@@ -0,0 +1,322 @@
+#include "SheetPreview.h"
+
+#include "card_utils.h"
+#include "resample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <sstream>
+
+SheetPreview::SheetPreview(size_t threadCount) : pool_(threadCount) {
+    updateLabel();
+}
+
+SheetPreview::~SheetPreview() {
+    for (const auto &entry: textures_) {
+        if (entry.texture.id != 0) {
+            UnloadTexture(entry.texture);
+        }
+    }
+}
+
+void SheetPreview::update(const CardPDFGenerator::Settings &settings, const std::string &frontImagesPath) {
+    borderColor_ = Color{static_cast<unsigned char>(settings.borderColor.r * 255),
+                         static_cast<unsigned char>(settings.borderColor.g * 255),
+                         static_cast<unsigned char>(settings.borderColor.b * 255), 255};
+
+    // Check the folder now and then; a different folder is checked right away
+    if (scanning_.valid() && scanning_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        folderSignature_ = scanning_.get();
+    }
+    if (!scanning_.valid() && (frontImagesPath != scannedPath_ || GetTime() - scannedAt_ >= rescanSeconds)) {
+        scannedPath_ = frontImagesPath;
+        scannedAt_ = GetTime();
+        scanning_ = std::async(std::launch::async, scanFolder, frontImagesPath);
+    }
+
+    // Only what changes the sheets; colours are read when drawing
+    std::ostringstream key;
+    key << settings.pageWidth << ' ' << settings.pageHeight << ' ' << settings.cardWidth << ' '
+        << settings.cardHeight << ' ' << settings.bleed << ' ' << settings.rows << ' ' << settings.columns << ' '
+        << settings.autoImpose << ' ' << settings.hasBorder << ' ' << settings.borderWidth << ' '
+        << settings.showGuideLines << ' ' << settings.guideLineWidth << ' ' << settings.copiesPerCard << ' '
+        << frontImagesPath << '\n' << folderSignature_;
+    if (key.str() != wantedKey_) {
+        wantedKey_ = key.str();
+        wantedSince_ = GetTime();
+        wantedSettings_ = settings;
+        wantedPath_ = frontImagesPath;
+    }
+
+    if (planning_.valid()) {
+        if (planning_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        plan_ = planning_.get();
+        sheet_ = std::min(sheet_, plan_.sheets.empty() ? 0 : plan_.sheets.size() - 1);
+        requestThumbnails();
+        updateLabel();
+    }
+
+    if (wantedKey_ != plannedKey_ && GetTime() - wantedSince_ >= settleSeconds) {
+        plannedKey_ = wantedKey_;
+        planning_ = std::async(std::launch::async, planDeck, wantedSettings_, wantedPath_);
+        updateLabel();
+    }
+}
+
+SheetPreview::Plan SheetPreview::planDeck(CardPDFGenerator::Settings settings, std::string frontImagesPath) {
+    // Nothing is written, so none of the output options matter
+    settings.backMode = CardPDFGenerator::BackMode::NoBack;
+    settings.sheetsPerFile = 0;
+    settings.incremental = false;
+    settings.spoolImages = false;
+    settings.diskCachePath.clear();
+
+    Plan plan;
+    try {
+        plan.generator = std::make_unique<CardPDFGenerator>(settings);
+        plan.sheets = plan.generator->planDeck(frontImagesPath, plan.frontImages);
+        for (const auto &image: plan.frontImages) {
+            plan.frontKeys.push_back(make_image_file_key(image));
+        }
+    } catch (const std::exception &e) {
+        plan.sheets.clear();
+        plan.frontKeys.clear();
+        plan.error = e.what();
+    }
+    return plan;
+}
+
+// Everything getCardEntries() reads: the names of the files, and the sizes and times
+// that change when an image or quantities.txt is edited
+std::uint64_t SheetPreview::scanFolder(const std::string &path) {
+    std::vector<std::string> files;
+    std::error_code error;
+    for (fs::directory_iterator entry(path, error), end; !error && entry != end; entry.increment(error)) {
+        std::error_code statError;
+        if (!entry->is_regular_file(statError)) {
+            continue;
+        }
+        std::ostringstream file;
+        file << entry->path().filename().string() << '\n' << entry->file_size(statError) << ' '
+             << entry->last_write_time(statError).time_since_epoch().count();
+        files.push_back(file.str());
+    }
+    std::sort(files.begin(), files.end()); // directory order is arbitrary
+
+    std::string listing;
+    for (const auto &file: files) {
+        listing += file + '\n';
+    }
+    return hash_bytes(reinterpret_cast<const unsigned char *>(listing.data()), listing.size());
+}
+
+void SheetPreview::requestThumbnails() {
+    // The shown sheet first, then the ones after it
+    std::vector<ImageFileKey> wanted;
+    wanted_.clear();
+    size_t lastSheet = std::min(plan_.sheets.size(), sheet_ + 1 + lookaheadSheets);
+    for (size_t index = sheet_; index < lastSheet; ++index) {
+        const auto &sheet = plan_.sheets[index];
+        for (size_t card = sheet.firstCard; card < sheet.firstCard + sheet.cardCount; ++card) {
+            if (wanted_.insert(plan_.frontKeys[card]).second) {
+                wanted.push_back(plan_.frontKeys[card]);
+            }
+        }
+    }
+
+    // Uploaded ones move to the front, so eviction takes those wanted longest ago
+    for (auto key = wanted.rbegin(); key != wanted.rend(); ++key) {
+        auto texture = textureIndex_.find(*key);
+        if (texture != textureIndex_.end()) {
+            textures_.splice(textures_.begin(), textures_, texture->second);
+        }
+    }
+
+    size_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Move the wanted images that are still waiting to the front, in order
+        for (auto key = wanted.rbegin(); key != wanted.rend(); ++key) {
+            if (requested_.insert(*key).second) {
+                added++;
+            } else {
+                auto waiting = std::find(pending_.begin(), pending_.end(), *key);
+                if (waiting == pending_.end()) {
+                    continue; // already decoded
+                }
+                pending_.erase(waiting);
+            }
+            pending_.push_front(*key);
+        }
+    }
+
+    // Each task decodes whichever image is most wanted when a worker gets to it
+    for (size_t i = 0; i < added; ++i) {
+        pool_.submit([this] { decodeNext(); });
+    }
+}
+
+void SheetPreview::decodeNext() {
+    ImageFileKey key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.empty()) {
+            return;
+        }
+        key = std::move(pending_.front());
+        pending_.pop_front();
+    }
+
+    Thumbnail thumbnail = loadThumbnail(key.path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.emplace_back(std::move(key), std::move(thumbnail));
+}
+
+SheetPreview::Thumbnail SheetPreview::loadThumbnail(const std::string &imagePath) {
+    // Decoding only touches CPU memory, so it is safe off the render thread
+    Thumbnail thumbnail;
+    Image image = LoadImage(imagePath.c_str());
+    if (!IsImageValid(image)) {
+        return thumbnail; // e.g. a JPEG with raylib built without JPEG support
+    }
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+    float scale = std::min(1.0f, static_cast<float>(maxThumbnailSize) / static_cast<float>(std::max(image.width, image.height)));
+    thumbnail.width = std::max(1, static_cast<int>(std::lround(image.width * scale)));
+    thumbnail.height = std::max(1, static_cast<int>(std::lround(image.height * scale)));
+    thumbnail.pixels = resample_area(static_cast<const unsigned char *>(image.data), image.width, image.height, 4,
+                                     thumbnail.width, thumbnail.height);
+    UnloadImage(image);
+    return thumbnail;
+}
+
+void SheetPreview::uploadThumbnails(double budgetSeconds) {
+    double start = GetTime();
+    bool uploaded = false;
+    do {
+        std::pair<ImageFileKey, Thumbnail> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ready_.empty()) {
+                break;
+            }
+            next = std::move(ready_.front());
+            ready_.pop_front();
+        }
+
+        Texture2D texture{};
+        Thumbnail &thumbnail = next.second;
+        if (!thumbnail.pixels.empty()) {
+            Image image{thumbnail.pixels.data(), thumbnail.width, thumbnail.height, 1,
+                        PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+            texture = LoadTextureFromImage(image);
+            SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+        }
+        textures_.push_front(Texture{std::move(next.first), texture});
+        textureIndex_[textures_.front().key] = textures_.begin();
+        uploaded = true;
+    } while (GetTime() - start < budgetSeconds);
+
+    if (uploaded) {
+        evictTextures();
+    }
+}
+
+void SheetPreview::evictTextures() {
+    // Least recently wanted first; an evicted image is decoded again if it is wanted later
+    auto entry = textures_.end();
+    while (textures_.size() > maxTextures && entry != textures_.begin()) {
+        --entry;
+        if (wanted_.contains(entry->key)) {
+            continue;
+        }
+        if (entry->texture.id != 0) {
+            UnloadTexture(entry->texture);
+        }
+        requested_.erase(entry->key);
+        textureIndex_.erase(entry->key);
+        entry = textures_.erase(entry);
+    }
+}
+
+void SheetPreview::draw(Rectangle bounds) const {
+    if (plan_.sheets.empty()) {
+        return;
+    }
+    const CardPDFGenerator::Sheet &sheet = plan_.sheets[sheet_];
+    const LayoutPlan &layout = *sheet.plan;
+
+    // Points to screen pixels; PDF y runs up, the screen's runs down
+    float scale = std::min(bounds.width / layout.pageWidth, bounds.height / layout.pageHeight);
+    float left = bounds.x + ((bounds.width - (layout.pageWidth * scale)) / 2);
+    float top = bounds.y + ((bounds.height - (layout.pageHeight * scale)) / 2);
+    auto toScreen = [&](const LayoutPlan::Rect &rect) {
+        return Rectangle{left + (rect.x * scale), top + ((layout.pageHeight - rect.y - rect.height) * scale),
+                         rect.width * scale, rect.height * scale};
+    };
+
+    Rectangle page{left, top, layout.pageWidth * scale, layout.pageHeight * scale};
+    DrawRectangleRec(page, WHITE);
+    DrawRectangleLinesEx(page, 1.0f, LIGHTGRAY);
+
+    // Same order as the PDF: guide lines and borders, then the cards
+    for (const auto &line: layout.guideLines) {
+        DrawLineEx({left + (line.x0 * scale), top + ((layout.pageHeight - line.y0) * scale)},
+                   {left + (line.x1 * scale), top + ((layout.pageHeight - line.y1) * scale)},
+                   std::max(1.0f, layout.guideLineWidth * scale), GRAY);
+    }
+    for (size_t slot = 0; slot < sheet.cardCount && slot < layout.borders.size(); ++slot) {
+        DrawRectangleLinesEx(toScreen(layout.borders[slot]), std::max(1.0f, layout.borderWidth * scale), borderColor_);
+    }
+
+    for (size_t slot = 0; slot < sheet.cardCount; ++slot) {
+        const LayoutPlan::Rect &rect = layout.frontSlots[slot];
+        Rectangle dest = toScreen(rect);
+        auto texture = textureIndex_.find(plan_.frontKeys[sheet.firstCard + slot]);
+        if (texture == textureIndex_.end() || texture->second->texture.id == 0) {
+            DrawRectangleRec(dest, Color{220, 220, 220, 255});
+            continue;
+        }
+
+        // Drawn around the slot's centre; a rotated card's image is as wide as the slot is high
+        float width = rect.rotated ? dest.height : dest.width;
+        float height = rect.rotated ? dest.width : dest.height;
+        float rotation = (rect.rotated ? -90.0f : 0.0f) + (rect.upsideDown ? 180.0f : 0.0f);
+        const Texture2D &image = texture->second->texture;
+        DrawTexturePro(image, {0.0f, 0.0f, static_cast<float>(image.width), static_cast<float>(image.height)},
+                       {dest.x + (dest.width / 2), dest.y + (dest.height / 2), width, height},
+                       {width / 2, height / 2}, rotation, WHITE);
+    }
+}
+
+void SheetPreview::showSheet(int delta) {
+    if (plan_.sheets.empty()) {
+        return;
+    }
+    long target = static_cast<long>(sheet_) + delta;
+    sheet_ = static_cast<size_t>(std::clamp(target, 0L, static_cast<long>(plan_.sheets.size()) - 1));
+    requestThumbnails();
+    updateLabel();
+}
+
+void SheetPreview::updateLabel() {
+    std::ostringstream text;
+    if (planning_.valid()) {
+        text << "Reading images...";
+    } else if (!plan_.error.empty()) {
+        text << "Preview unavailable: " << plan_.error;
+    } else if (plan_.sheets.empty()) {
+        text << "No images to preview";
+    } else {
+        text << "Sheet " << sheet_ + 1 << " / " << plan_.sheets.size() << " (" << plan_.frontImages.size()
+             << " cards)";
+    }
+    label_ = text.str();
+}
+
+const char *SheetPreview::label() const {
+    return label_.c_str();
+}
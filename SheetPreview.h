@@ -0,0 +1,161 @@
+#ifndef SHEET_PREVIEW_H
+#define SHEET_PREVIEW_H
+
+#include "raylib.h"
+
+#include "CardPDFGenerator.h"
+#include "ThreadPool.h"
+#include "image_loader.h"
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Draws the sheets of a deck the way generatePDF() will print them
+ *
+ * The deck is planned with CardPDFGenerator::planDeck() on a background thread, and
+ * card thumbnails are decoded and downscaled on a worker pool, the cards of the shown
+ * sheet first. The render thread only uploads finished thumbnails as textures, a few
+ * milliseconds' worth per frame, so the window keeps its frame rate while they stream in.
+ * Thumbnails are identified by path, size and modification time like ImageCache entries,
+ * so an edited image is loaded again, and only the most recently wanted ones stay
+ * uploaded.
+ *
+ * All methods are called from the thread that owns the window; destroy the preview
+ * before the window is closed, as it releases its textures.
+ */
+class SheetPreview {
+public:
+    /**
+     * @brief Start the thumbnail workers
+     *
+     * @param threadCount Number of worker threads; 0 uses one per hardware thread
+     */
+    explicit SheetPreview(size_t threadCount = 0);
+
+    ~SheetPreview();
+
+    SheetPreview(const SheetPreview &) = delete;
+
+    SheetPreview &operator=(const SheetPreview &) = delete;
+
+    /**
+     * @brief Plan the deck again when the layout settings or the front images change
+     *
+     * The folder is rescanned in the background every few seconds, so adding, removing
+     * or editing images or quantities.txt replans too. Replanning waits until the values
+     * have stayed the same for a moment, so dragging a slider does not rescan the folder
+     * every frame. Also collects a finished plan.
+     *
+     * @param settings Current settings
+     * @param frontImagesPath Directory containing the front images
+     */
+    void update(const CardPDFGenerator::Settings &settings, const std::string &frontImagesPath);
+
+    /**
+     * @brief Turn decoded thumbnails into textures
+     *
+     * @param budgetSeconds Time to spend on uploads this frame (at least one is uploaded)
+     */
+    void uploadThumbnails(double budgetSeconds = 0.004);
+
+    /**
+     * @brief Draw the current sheet, fitted and centred in a rectangle of the window
+     *
+     * Cards whose thumbnail has not arrived yet are drawn as grey boxes.
+     *
+     * @param bounds Area to draw in, in screen pixels
+     */
+    void draw(Rectangle bounds) const;
+
+    /**
+     * @brief Move to another sheet
+     *
+     * @param delta Number of sheets to move forward (negative to go back)
+     */
+    void showSheet(int delta);
+
+    /**
+     * @brief Get a line describing what is shown, for a label next to the preview
+     * @return const char* E.g. "Sheet 2 / 14", valid until the next call to update() or showSheet()
+     */
+    const char *label() const;
+
+private:
+    static constexpr int maxThumbnailSize = 192; ///< Longest side of a thumbnail in pixels
+    static constexpr int lookaheadSheets = 4;    ///< Sheets after the shown one whose thumbnails are loaded too
+    static constexpr double settleSeconds = 0.3; ///< How long settings must stay unchanged before replanning
+    static constexpr double rescanSeconds = 2.0; ///< Time between checks of the folder for changes
+    static constexpr size_t maxTextures = 256;   ///< Uploaded thumbnails kept (more if the wanted ones need it)
+
+    struct Plan {
+        std::unique_ptr<CardPDFGenerator> generator; ///< Owns the layout plans the sheets point to
+        std::vector<CardPDFGenerator::Sheet> sheets;
+        std::vector<fs::path> frontImages;
+        std::vector<ImageFileKey> frontKeys; ///< Version of each front image when planned
+        std::string error;
+    };
+
+    struct Thumbnail {
+        std::vector<unsigned char> pixels; ///< RGBA, empty if the file could not be decoded
+        int width = 0;
+        int height = 0;
+    };
+
+    struct Texture {
+        ImageFileKey key;
+        Texture2D texture; ///< id 0 if the file could not be decoded
+    };
+
+    static Plan planDeck(CardPDFGenerator::Settings settings, std::string frontImagesPath);
+
+    static std::uint64_t scanFolder(const std::string &path);
+
+    static Thumbnail loadThumbnail(const std::string &imagePath);
+
+    void requestThumbnails();
+
+    void decodeNext();
+
+    void evictTextures();
+
+    void updateLabel();
+
+    Plan plan_;
+    std::future<Plan> planning_;
+    std::string plannedKey_;   ///< Settings, path and folder signature of plan_, or of the plan being made
+    std::string wantedKey_;    ///< Settings, path and folder signature last seen by update()
+    double wantedSince_ = 0.0; ///< When wantedKey_ last changed (GetTime())
+    CardPDFGenerator::Settings wantedSettings_;
+    std::string wantedPath_;
+    std::future<std::uint64_t> scanning_;
+    std::string scannedPath_;           ///< Folder of the last scan started
+    std::uint64_t folderSignature_ = 0; ///< Hash of the names, sizes and times of the files in it
+    double scannedAt_ = 0.0;            ///< When the last scan started (GetTime())
+    Color borderColor_ = BLACK;
+    size_t sheet_ = 0;
+    std::string label_;
+
+    std::list<Texture> textures_; ///< Uploaded thumbnails, most recently wanted first
+    std::unordered_map<ImageFileKey, std::list<Texture>::iterator, ImageFileKeyHash> textureIndex_;
+    std::unordered_set<ImageFileKey, ImageFileKeyHash> wanted_; ///< Shown and lookahead cards, never evicted
+
+    std::mutex mutex_; ///< Guards pending_ and ready_
+    std::deque<ImageFileKey> pending_; ///< Images waiting for a worker, most wanted first
+    std::deque<std::pair<ImageFileKey, Thumbnail>> ready_; ///< Decoded, waiting for upload
+    /// Images queued, decoded or uploaded; evicted ones are removed (render thread only)
+    std::unordered_set<ImageFileKey, ImageFileKeyHash> requested_;
+
+    ThreadPool pool_; ///< Declared last so the workers stop before the queues go away
+};
+
+#endif // SHEET_PREVIEW_H
@@ -0,0 +1,97 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads executing queued tasks in FIFO order
+ *
+ * Tasks still queued when the pool is destroyed are dropped (their futures report
+ * std::future_error); tasks already running are waited for.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Start the worker threads
+     *
+     * @param threadCount Number of workers; 0 uses one per hardware thread
+     */
+    explicit ThreadPool(size_t threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        workers_.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            tasks_ = {};
+        }
+        available_.notify_all();
+        for (auto &worker: workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queue a task for execution on a worker thread
+     *
+     * @param task Callable taking no arguments
+     * @return std::future holding the task's result or exception
+     */
+    template<typename F>
+    auto submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([packaged] { (*packaged)(); });
+        }
+        available_.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers_.size(); } ///< Number of worker threads
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_) return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H
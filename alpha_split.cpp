@@ -0,0 +1,116 @@
+#include "alpha_split.h"
+
+#include <algorithm>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Each kernel handles a prefix of the pixels, ANDs the alpha values it sees into
+// opaque and returns how many pixels it consumed; the scalar loop does the rest.
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// 16 gray+alpha pixels per step: even bytes are gray, odd bytes alpha
+size_t split_gray_alpha(const unsigned char* pixels, size_t pixelCount, unsigned char* gray,
+                        unsigned char* alpha, unsigned char& opaque) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i alphaAnd = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 2));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 2 + 16));
+        __m128i g = _mm_packus_epi16(_mm_and_si128(v0, lowBytes), _mm_and_si128(v1, lowBytes));
+        __m128i a = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), g);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(alpha + i), a);
+        alphaAnd = _mm_and_si128(alphaAnd, a);
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(alphaAnd, _mm_set1_epi8(-1))) != 0xFFFF) {
+        opaque = 0;
+    }
+    return i;
+}
+
+// 16 RGBA pixels per step. Alpha is the top byte of each 32-bit pixel and narrows
+// with two packs; RGB needs a byte shuffle, so without SSSE3 only alpha is vectorized.
+size_t split_rgba(const unsigned char* pixels, size_t pixelCount, unsigned char* rgb,
+                  unsigned char* alpha, unsigned char& opaque) {
+    __m128i alphaAnd = _mm_set1_epi8(-1);
+#if defined(__SSSE3__)
+    const __m128i packRgb = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+#endif
+    size_t i = 0;
+    for (; i + 16 <= pixelCount; i += 16) {
+        const unsigned char* src = pixels + i * 4;
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+
+        __m128i a01 = _mm_packs_epi32(_mm_srli_epi32(v0, 24), _mm_srli_epi32(v1, 24));
+        __m128i a23 = _mm_packs_epi32(_mm_srli_epi32(v2, 24), _mm_srli_epi32(v3, 24));
+        __m128i a = _mm_packus_epi16(a01, a23);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(alpha + i), a);
+        alphaAnd = _mm_and_si128(alphaAnd, a);
+
+#if defined(__SSSE3__)
+        // Four packed 12-byte groups stitched into three 16-byte stores
+        __m128i c0 = _mm_shuffle_epi8(v0, packRgb);
+        __m128i c1 = _mm_shuffle_epi8(v1, packRgb);
+        __m128i c2 = _mm_shuffle_epi8(v2, packRgb);
+        __m128i c3 = _mm_shuffle_epi8(v3, packRgb);
+        unsigned char* dst = rgb + i * 3;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                         _mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16),
+                         _mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32),
+                         _mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+#else
+        for (size_t p = 0; p < 16; ++p) {
+            rgb[(i + p) * 3] = src[p * 4];
+            rgb[(i + p) * 3 + 1] = src[p * 4 + 1];
+            rgb[(i + p) * 3 + 2] = src[p * 4 + 2];
+        }
+#endif
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(alphaAnd, _mm_set1_epi8(-1))) != 0xFFFF) {
+        opaque = 0;
+    }
+    return i;
+}
+
+#else
+
+size_t split_gray_alpha(const unsigned char*, size_t, unsigned char*, unsigned char*, unsigned char&) {
+    return 0;
+}
+
+size_t split_rgba(const unsigned char*, size_t, unsigned char*, unsigned char*, unsigned char&) {
+    return 0;
+}
+
+#endif
+
+} // namespace
+
+bool split_alpha(const unsigned char* pixels, size_t colorChannels, size_t pixelCount,
+                 unsigned char* color, unsigned char* alpha) {
+    unsigned char opaque = 0xFF;
+    size_t i = colorChannels == 3 ? split_rgba(pixels, pixelCount, color, alpha, opaque)
+                                  : split_gray_alpha(pixels, pixelCount, color, alpha, opaque);
+
+    const size_t stride = colorChannels + 1;
+    for (; i < pixelCount; ++i) {
+        const unsigned char* px = pixels + i * stride;
+        std::copy(px, px + colorChannels, color + i * colorChannels);
+        alpha[i] = px[colorChannels];
+        opaque &= px[colorChannels];
+    }
+    return opaque == 0xFF;
+}
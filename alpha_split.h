@@ -0,0 +1,22 @@
+#ifndef ALPHA_SPLIT_H
+#define ALPHA_SPLIT_H
+
+#include <cstddef>
+
+/**
+ * @brief Split interleaved pixels with alpha into a color plane and an alpha plane
+ *
+ * PDF images cannot carry interleaved alpha: the color goes into the image and the
+ * alpha into a separate soft mask. Uses SSE2 shuffles (SSSE3 for RGBA) when available.
+ *
+ * @param pixels Source pixels, colorChannels + 1 bytes each (gray+alpha or RGBA)
+ * @param colorChannels 1 (gray) or 3 (RGB)
+ * @param pixelCount Number of pixels
+ * @param color Output color plane, colorChannels bytes per pixel
+ * @param alpha Output alpha plane, 1 byte per pixel
+ * @return true if every alpha value is 255, i.e. the soft mask can be dropped
+ */
+bool split_alpha(const unsigned char* pixels, size_t colorChannels, size_t pixelCount,
+                 unsigned char* color, unsigned char* alpha);
+
+#endif //ALPHA_SPLIT_H
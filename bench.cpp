@@ -0,0 +1,425 @@
+#include "CardPDFGenerator.h"
+#include <png.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <jpeglib.h> // after <cstdio>, which it needs for FILE
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Benchmark for CardPDFGenerator: synthesizes a deck of JPEG, PNG and RGBA PNG cards at
+// several resolutions, generates it with every back mode on a few grids and prints one
+// JSON object per run (cards/s, MB/s, peak RSS, output size) for regression tracking.
+// Each run is generated in a child process where fork() is available, so its peak
+// RSS is its own rather than the high-water mark of every run before it.
+
+namespace {
+
+// --- Synthetic images ---
+
+// Smooth gradients with a little noise: compresses like scanned artwork rather than
+// like flat color (too easy) or pure noise (incompressible)
+std::vector<unsigned char> make_pixels(int width, int height, int channels, int seed, bool translucent) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+    std::minstd_rand noise(seed);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char* px = &pixels[(static_cast<size_t>(y) * width + x) * channels];
+            int n = static_cast<int>(noise() % 16);
+            px[0] = static_cast<unsigned char>((x * 255 / width + seed * 37 + n) & 0xFF);
+            px[1] = static_cast<unsigned char>((y * 255 / height + seed * 91 + n) & 0xFF);
+            px[2] = static_cast<unsigned char>(((x + y) * 127 / (width + height) + 64 + n) & 0xFF);
+            if (channels == 4) {
+                // Rounded-corner style mask: transparent only near the corners
+                bool corner = (x < width / 20 || x >= width - width / 20) && (y < height / 20 || y >= height - height / 20);
+                px[3] = translucent && corner ? 0 : 255;
+            }
+        }
+    }
+    return pixels;
+}
+
+void write_png(const fs::path& path, const std::vector<unsigned char>& pixels, int width, int height, int channels) {
+    png_image image{};
+    image.version = PNG_IMAGE_VERSION;
+    image.width = width;
+    image.height = height;
+    image.format = channels == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB;
+    if (!png_image_write_to_file(&image, path.string().c_str(), 0, pixels.data(), 0, nullptr)) {
+        throw std::runtime_error("Failed to write " + path.string() + ": " + image.message);
+    }
+}
+
+void write_jpeg(const fs::path& path, const std::vector<unsigned char>& rgb, int width, int height, int quality) {
+    FILE* file = std::fopen(path.string().c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+
+    // The default error handler exits with libjpeg's message, which is enough here
+    jpeg_compress_struct info{};
+    jpeg_error_mgr errors{};
+    info.err = jpeg_std_error(&errors);
+    jpeg_create_compress(&info);
+    jpeg_stdio_dest(&info, file);
+    info.image_width = static_cast<JDIMENSION>(width);
+    info.image_height = static_cast<JDIMENSION>(height);
+    info.input_components = 3;
+    info.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        auto row = const_cast<JSAMPROW>(&rgb[static_cast<size_t>(info.next_scanline) * width * 3]);
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+
+    if (std::fclose(file) != 0) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+}
+
+// Cards cycle through JPEG, RGB PNG, opaque RGBA PNG and RGBA PNG with transparent
+// corners, at 150, 300 and 600 DPI for a 63x88 mm card.
+void make_deck(const fs::path& directory, int cards) {
+    const int sizes[3][2] = {{372, 520}, {744, 1039}, {1488, 2079}};
+    fs::create_directories(directory);
+    for (int i = 0; i < cards; ++i) {
+        const int* size = sizes[i % 3];
+        char name[32];
+        switch (i % 4) {
+            case 0:
+                snprintf(name, sizeof(name), "card%04d.jpg", i);
+                write_jpeg(directory / name, make_pixels(size[0], size[1], 3, i, false), size[0], size[1], 90);
+                break;
+            case 1:
+                snprintf(name, sizeof(name), "card%04d.png", i);
+                write_png(directory / name, make_pixels(size[0], size[1], 3, i, false), size[0], size[1], 3);
+                break;
+            default:
+                snprintf(name, sizeof(name), "card%04d.png", i);
+                write_png(directory / name, make_pixels(size[0], size[1], 4, i, i % 4 == 3), size[0], size[1], 4);
+                break;
+        }
+    }
+}
+
+// --- Measurement ---
+
+struct RunResult {
+    double seconds = 0;
+    std::uint64_t peakImageBytes = 0; ///< CardPDFGenerator::Progress::peakImageBytes
+    std::uint64_t peakRssBytes = 0;   ///< Peak resident set size of the run
+};
+
+// Output of a generatePDF() call: the file itself, or with sheetsPerFile the
+// name.partN.pdf files next to it (any stale ones were removed before the run)
+std::vector<fs::path> output_files(const fs::path& outputPath) {
+    std::vector<fs::path> files;
+    if (fs::exists(outputPath)) {
+        files.push_back(outputPath);
+    }
+    const std::string prefix = outputPath.stem().string() + ".part";
+    const std::string extension = outputPath.extension().string();
+    for (const auto& entry : fs::directory_iterator(outputPath.parent_path())) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() + extension.size() || name.rfind(prefix, 0) != 0 ||
+            name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+            continue;
+        }
+        std::string number = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+        if (std::all_of(number.begin(), number.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            files.push_back(entry.path());
+        }
+    }
+    return files;
+}
+
+std::uint64_t output_size(const fs::path& outputPath) {
+    std::uint64_t total = 0;
+    for (const auto& file : output_files(outputPath)) {
+        total += fs::file_size(file);
+    }
+    return total;
+}
+
+RunResult generate(const CardPDFGenerator::Settings& settings, const fs::path& output, const fs::path& deck,
+                   const std::string& backPath) {
+    for (const auto& file : output_files(output)) {
+        fs::remove(file);
+    }
+    RunResult result;
+    auto start = std::chrono::steady_clock::now();
+    CardPDFGenerator generator(settings);
+    generator.generatePDF(output.string(), deck.string(), backPath);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.peakImageBytes = generator.progress().peakImageBytes;
+    return result;
+}
+
+#ifdef _WIN32
+// No fork(): the run shares the process, whose peak covers every run so far
+RunResult measure(const CardPDFGenerator::Settings& settings, const fs::path& output, const fs::path& deck,
+                  const std::string& backPath) {
+    RunResult result = generate(settings, output, deck, backPath);
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    result.peakRssBytes = counters.PeakWorkingSetSize;
+    return result;
+}
+#else
+// Runs the generator in a child process; the child sends its RunResult (or an error
+// message) through a pipe and wait4() reports the child's own peak RSS
+RunResult measure(const CardPDFGenerator::Settings& settings, const fs::path& output, const fs::path& deck,
+                  const std::string& backPath) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error(std::string("Failed to create a pipe: ") + std::strerror(errno));
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        throw std::runtime_error(std::string("Failed to start a run: ") + std::strerror(errno));
+    }
+
+    if (child == 0) {
+        close(fds[0]);
+        std::string message;
+        int status = 0;
+        try {
+            RunResult result = generate(settings, output, deck, backPath);
+            message.assign(reinterpret_cast<const char*>(&result), sizeof(result));
+        } catch (const std::exception& e) {
+            message = e.what();
+            status = 1;
+        }
+        for (size_t written = 0; written < message.size();) {
+            ssize_t count = write(fds[1], message.data() + written, message.size() - written);
+            if (count <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(count);
+        }
+        _exit(status); // skip the parent's atexit handlers and stream flushes
+    }
+
+    close(fds[1]);
+    std::string message;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0 || (count < 0 && errno == EINTR)) {
+        if (count > 0) {
+            message.append(buffer, static_cast<size_t>(count));
+        }
+    }
+    close(fds[0]);
+
+    int status = 0;
+    rusage usage{};
+    while (wait4(child, &status, 0, &usage) < 0 && errno == EINTR) {
+    }
+    bool failed = WIFEXITED(status) && WEXITSTATUS(status) != 0;
+    if (!WIFEXITED(status) || failed || message.size() != sizeof(RunResult)) {
+        throw std::runtime_error(failed && !message.empty() ? message : "Benchmark run crashed");
+    }
+
+    RunResult result;
+    std::memcpy(&result, message.data(), sizeof(result));
+#ifdef __APPLE__
+    result.peakRssBytes = static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+    result.peakRssBytes = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    return result;
+}
+#endif
+
+const char* back_mode_name(CardPDFGenerator::BackMode mode) {
+    switch (mode) {
+        case CardPDFGenerator::BackMode::NoBack: return "NoBack";
+        case CardPDFGenerator::BackMode::SameBack: return "SameBack";
+        case CardPDFGenerator::BackMode::UniqueBack: return "UniqueBack";
+    }
+    return "";
+}
+
+// Whole-string parse of an option value; false if text is not entirely a number
+template <typename T>
+bool parse_number(const std::string& text, T& value) {
+    size_t parsed = 0;
+    try {
+        if constexpr (std::is_integral_v<T>) {
+            value = std::stoi(text, &parsed);
+        } else {
+            value = std::stof(text, &parsed);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return parsed == text.size();
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "\nOptions:\n"
+              << "  --cards <n>        Cards in the synthetic deck (default 90)\n"
+              << "  --dir <path>       Working directory for the deck and the PDFs (default card_layout_bench)\n"
+              << "  --repeat <n>       Runs per configuration; the fastest is reported (default 1)\n"
+              << "  --threads <n>      Settings::workerThreads (default 0 = one per core)\n"
+              << "  --max-dpi <dpi>    Settings::maxImageDpi (default 0)\n"
+              << "  --cmyk             Enable Settings::convertToCmyk\n"
+              << "  --json <file>      Also write the results to a file\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int cards = 90;
+    int repeat = 1;
+    fs::path directory = "card_layout_bench";
+    std::string jsonPath;
+    CardPDFGenerator::Settings base;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        auto invalid = [&](const char* expected) {
+            std::cerr << "Invalid value for " << arg << " (expected " << expected << "): " << argv[i] << std::endl;
+            return 1;
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--cards") {
+            if (!parse_number(value(), cards) || cards <= 0) {
+                return invalid("a count of 1 or more");
+            }
+        } else if (arg == "--dir") {
+            directory = value();
+        } else if (arg == "--repeat") {
+            if (!parse_number(value(), repeat) || repeat <= 0) {
+                return invalid("a count of 1 or more");
+            }
+        } else if (arg == "--threads") {
+            if (!parse_number(value(), base.workerThreads) || base.workerThreads < 0) {
+                return invalid("a thread count of 0 or more");
+            }
+        } else if (arg == "--max-dpi") {
+            if (!parse_number(value(), base.maxImageDpi) || !(base.maxImageDpi >= 0.0f)) {
+                return invalid("a DPI of 0 or more");
+            }
+        } else if (arg == "--cmyk") {
+            base.convertToCmyk = true;
+        } else if (arg == "--json") {
+            jsonPath = value();
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const fs::path deck = directory / "deck";
+    const fs::path back = directory / "back.png";
+    const fs::path output = directory / "bench.pdf";
+    std::vector<std::string> results;
+    try {
+        auto started = std::chrono::steady_clock::now();
+        make_deck(deck, cards);
+        write_png(back, make_pixels(744, 1039, 3, 7, false), 744, 1039, 3);
+        double synthesisSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cerr << "Synthesized " << cards << " cards in " << synthesisSeconds << " s" << std::endl;
+
+        const struct { int rows, columns; float cardWidth, cardHeight; } grids[] = {
+            {3, 3, 63.0f, 88.0f}, // poker cards on A4
+            {2, 2, 88.0f, 126.0f} // large cards on A4
+        };
+        const CardPDFGenerator::BackMode modes[] = {CardPDFGenerator::BackMode::NoBack,
+                                                    CardPDFGenerator::BackMode::SameBack,
+                                                    CardPDFGenerator::BackMode::UniqueBack};
+
+        for (const auto& grid : grids) {
+            for (auto mode : modes) {
+                CardPDFGenerator::Settings settings = base;
+                settings.rows = grid.rows;
+                settings.columns = grid.columns;
+                settings.cardWidth = grid.cardWidth;
+                settings.cardHeight = grid.cardHeight;
+                settings.backMode = mode;
+                // UniqueBack pairs every card with itself as its back
+                std::string backPath = mode == CardPDFGenerator::BackMode::SameBack ? back.string() : deck.string();
+
+                // Fastest time; memory is the most any repetition used
+                RunResult best;
+                for (int run = 0; run < repeat; ++run) {
+                    RunResult result = measure(settings, output, deck, backPath);
+                    best.seconds = run == 0 ? result.seconds : std::min(best.seconds, result.seconds);
+                    best.peakImageBytes = std::max(best.peakImageBytes, result.peakImageBytes);
+                    best.peakRssBytes = std::max(best.peakRssBytes, result.peakRssBytes);
+                }
+
+                std::uint64_t bytes = output_size(output);
+                std::ostringstream json;
+                json << "{\"cards\": " << cards
+                     << ", \"grid\": \"" << grid.rows << "x" << grid.columns << "\""
+                     << ", \"backMode\": \"" << back_mode_name(mode) << "\""
+                     << ", \"threads\": " << settings.workerThreads
+                     << ", \"maxImageDpi\": " << settings.maxImageDpi
+                     << ", \"cmyk\": " << (settings.convertToCmyk ? "true" : "false")
+                     << ", \"seconds\": " << best.seconds
+                     << ", \"cardsPerSecond\": " << cards / best.seconds
+                     << ", \"outputBytes\": " << bytes
+                     << ", \"outputMBPerSecond\": " << bytes / 1048576.0 / best.seconds
+                     << ", \"peakImageBytes\": " << best.peakImageBytes
+                     << ", \"peakRssBytes\": " << best.peakRssBytes << "}";
+                std::cout << json.str() << std::endl;
+                results.push_back(json.str());
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath);
+        file << "[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            file << "  " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "]\n";
+    }
+    return 0;
+}
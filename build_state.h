@@ -0,0 +1,60 @@
+#ifndef BUILD_STATE_H
+#define BUILD_STATE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// What the last incremental generatePDF run produced, stored next to its output so
+// the next run can tell which output files are still current.
+struct BuildState {
+    std::uint64_t settings = 0;         // fingerprint of the settings that affect the output
+    std::vector<std::uint64_t> sheets;  // fingerprint of each sheet's input images, in page order
+    std::vector<std::string> files;     // output files written
+};
+
+// Path of the build state file belonging to an output PDF.
+inline std::filesystem::path build_state_path(const std::string& outputPath) {
+    return std::filesystem::path(outputPath + ".buildstate");
+}
+
+// Loads a build state file. A missing or unreadable file gives an empty state, which
+// matches nothing and so rebuilds everything.
+inline BuildState load_build_state(const std::filesystem::path& path) {
+    BuildState state;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        size_t separator = line.find(" = ");
+        if (line.empty() || line[0] == '#' || separator == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, separator);
+        std::string value = line.substr(separator + 3);
+        try {
+            if (key == "settings") state.settings = std::stoull(value, nullptr, 16);
+            else if (key == "sheet") state.sheets.push_back(std::stoull(value, nullptr, 16));
+            else if (key == "file") state.files.push_back(value);
+        } catch (const std::exception&) {
+            return BuildState{};
+        }
+    }
+    return state;
+}
+
+// Writes a build state file.
+inline void save_build_state(const std::filesystem::path& path, const BuildState& state) {
+    std::ofstream ofs(path);
+    ofs << "# Written by card_layout; deleting it forces a full rebuild\n";
+    ofs << "settings = " << std::hex << state.settings << "\n";
+    for (std::uint64_t sheet : state.sheets) {
+        ofs << "sheet = " << sheet << "\n";
+    }
+    for (const std::string& file : state.files) {
+        ofs << "file = " << file << "\n";
+    }
+}
+
+#endif //BUILD_STATE_H
@@ -1,32 +1,103 @@
 #include "card_utils.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
 #include <filesystem>
+#include <fstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
-void duplicate_cards(const char* source_dir, const char* dest_dir, int count) {
-    if (!fs::exists(source_dir)) {
-        throw std::runtime_error("Source directory does not exist.");
+std::uint64_t hash_bytes(const unsigned char* data, size_t size, std::uint64_t seed) {
+    std::uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::uint64_t hash_file(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open file for hashing: " + path.string());
     }
 
-    if (!fs::exists(dest_dir)) {
-        fs::create_directories(dest_dir);
+    std::uint64_t hash = hash_bytes(nullptr, 0);
+    std::vector<char> buffer(1 << 16);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash = hash_bytes(reinterpret_cast<const unsigned char*>(buffer.data()), static_cast<size_t>(file.gcount()), hash);
     }
+    return hash;
+}
 
-    for (const auto& entry : fs::directory_iterator(source_dir)) {
-        if (entry.is_regular_file()) {
-            std::string extension = entry.path().extension().string();
-            if (extension == ".png" || extension == ".jpg" || extension == ".jpeg") {
-                for (int i = 1; i <= count; ++i) {
-                    std::string new_filename = entry.path().stem().string() + "-" + std::to_string(i) + entry.path().extension().string();
-                    fs::path dest_path = fs::path(dest_dir) / new_filename;
-                    try {
-                        fs::copy_file(entry.path(), dest_path, fs::copy_options::overwrite_existing);
-                    } catch (const fs::filesystem_error& e) {
-                        throw std::runtime_error("Failed to copy file " + entry.path().string() + " to " + dest_path.string() + ": " + e.what());
-                    }
-                }
+bool natural_less(const std::string& a, const std::string& b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        unsigned char ca = a[i], cb = b[j];
+        if (std::isdigit(ca) && std::isdigit(cb)) {
+            size_t endA = i, endB = j;
+            while (endA < a.size() && std::isdigit(static_cast<unsigned char>(a[endA]))) endA++;
+            while (endB < b.size() && std::isdigit(static_cast<unsigned char>(b[endB]))) endB++;
+            // Compare values without leading zeros: more digits is larger, then digit by digit
+            while (i + 1 < endA && a[i] == '0') i++;
+            while (j + 1 < endB && b[j] == '0') j++;
+            if (endA - i != endB - j) {
+                return endA - i < endB - j;
+            }
+            int order = a.compare(i, endA - i, b, j, endB - j);
+            if (order != 0) {
+                return order < 0;
             }
+            i = endA;
+            j = endB;
+            continue;
         }
+        int la = std::tolower(ca), lb = std::tolower(cb);
+        if (la != lb) {
+            return la < lb;
+        }
+        ++i;
+        ++j;
+    }
+    if (i < a.size() || j < b.size()) {
+        return i == a.size(); // a prefix sorts first
+    }
+    return a < b;
+}
+
+void prefetch_file(const fs::path& path) {
+#ifdef _WIN32
+    // No asynchronous readahead hint for plain files: read it through instead, which is
+    // fine on the background thread that calls this
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {}
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+#ifdef __APPLE__
+    struct stat info {};
+    if (fstat(fd, &info) == 0) {
+        radvisory advice{};
+        advice.ra_offset = 0;
+        advice.ra_count = static_cast<int>(std::min<off_t>(info.st_size, INT_MAX));
+        fcntl(fd, F_RDADVISE, &advice);
     }
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+#endif
 }
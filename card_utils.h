@@ -5,6 +5,24 @@
 #ifndef CARD_UTILS_H
 #define CARD_UTILS_H
 
-void duplicate_cards(const char* source_dir, const char* dest_dir, int count);
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// 64-bit FNV-1a hash of a buffer; pass a previous result as seed to continue hashing
+std::uint64_t hash_bytes(const unsigned char* data, size_t size, std::uint64_t seed = 14695981039346656037ULL);
+
+// 64-bit FNV-1a hash of a file's contents
+std::uint64_t hash_file(const std::filesystem::path& path);
+
+// Natural order of file names: runs of digits compare by value and letters ignore case,
+// so "card2.png" sorts before "card10.png". Names equal in that order fall back to a
+// plain comparison, which keeps the order total.
+bool natural_less(const std::string& a, const std::string& b);
+
+// Asks the OS to start reading a file into the page cache in the background, so a later
+// read does not wait for the disk or network. Best effort: errors are ignored.
+void prefetch_file(const std::filesystem::path& path);
 
 #endif //CARD_UTILS_H
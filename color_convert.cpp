@@ -0,0 +1,143 @@
+#include "color_convert.h"
+#include "card_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kBlock = 256;
+
+// Converts one block of planar RGB to planar CMYK (values 0-255)
+void convert_block(const float* r, const float* g, const float* b,
+                   int* c, int* m, int* y, int* k, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 full = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 vr = _mm_loadu_ps(r + i);
+        __m128 vg = _mm_loadu_ps(g + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        __m128 vmax = _mm_max_ps(vr, _mm_max_ps(vg, vb));
+        // 255 / max, or 0 for black pixels (which have no C, M or Y)
+        __m128 scale = _mm_and_ps(_mm_cmpgt_ps(vmax, zero), _mm_div_ps(full, _mm_max_ps(vmax, _mm_set1_ps(1.0f))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(c + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(vmax, vr), scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(m + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(vmax, vg), scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(vmax, vb), scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(k + i), _mm_cvtps_epi32(_mm_sub_ps(full, vmax)));
+    }
+#endif
+    for (; i < count; ++i) {
+        float vmax = std::max(r[i], std::max(g[i], b[i]));
+        float scale = vmax > 0.0f ? 255.0f / vmax : 0.0f;
+        c[i] = static_cast<int>(std::lround((vmax - r[i]) * scale));
+        m[i] = static_cast<int>(std::lround((vmax - g[i]) * scale));
+        y[i] = static_cast<int>(std::lround((vmax - b[i]) * scale));
+        k[i] = static_cast<int>(std::lround(255.0f - vmax));
+    }
+}
+
+} // namespace
+
+void rgb_to_cmyk(const unsigned char* rgb, unsigned char* cmyk, size_t pixelCount) {
+    // Work on cache-resident planar blocks so the arithmetic runs four pixels at a time
+    float r[kBlock], g[kBlock], b[kBlock];
+    int c[kBlock], m[kBlock], y[kBlock], k[kBlock];
+
+    for (size_t start = 0; start < pixelCount; start += kBlock) {
+        const size_t count = std::min(kBlock, pixelCount - start);
+        const unsigned char* in = rgb + start * 3;
+        for (size_t i = 0; i < count; ++i) {
+            r[i] = in[i * 3];
+            g[i] = in[i * 3 + 1];
+            b[i] = in[i * 3 + 2];
+        }
+
+        convert_block(r, g, b, c, m, y, k, count);
+
+        unsigned char* out = cmyk + start * 4;
+        for (size_t i = 0; i < count; ++i) {
+            out[i * 4] = static_cast<unsigned char>(c[i]);
+            out[i * 4 + 1] = static_cast<unsigned char>(m[i]);
+            out[i * 4 + 2] = static_cast<unsigned char>(y[i]);
+            out[i * 4 + 3] = static_cast<unsigned char>(k[i]);
+        }
+    }
+}
+
+std::shared_ptr<const CmykLut> CmykLut::load(const std::filesystem::path& path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        throw std::runtime_error("Could not open CMYK table: " + path.string());
+    }
+
+    auto lut = std::make_shared<CmykLut>();
+    size_t expected = 0;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream iss(line);
+        if (line.rfind("LUT_3D_SIZE", 0) == 0) {
+            std::string keyword;
+            iss >> keyword >> lut->size_;
+            if (lut->size_ < 2 || lut->size_ > 256) {
+                throw std::runtime_error("Invalid LUT_3D_SIZE in CMYK table: " + path.string());
+            }
+            expected = static_cast<size_t>(lut->size_) * lut->size_ * lut->size_ * 4;
+            lut->table_.reserve(expected);
+            continue;
+        }
+        if (expected == 0) {
+            throw std::runtime_error("CMYK table must start with LUT_3D_SIZE: " + path.string());
+        }
+
+        float values[4];
+        if (!(iss >> values[0] >> values[1] >> values[2] >> values[3])) {
+            throw std::runtime_error("Malformed entry in CMYK table: " + path.string());
+        }
+        for (float v : values) {
+            lut->table_.push_back(std::clamp(v, 0.0f, 1.0f) * 255.0f);
+        }
+    }
+
+    if (expected == 0 || lut->table_.size() != expected) {
+        throw std::runtime_error("CMYK table has the wrong number of entries: " + path.string());
+    }
+    lut->fingerprint_ = hash_bytes(reinterpret_cast<const unsigned char*>(lut->table_.data()),
+                                   lut->table_.size() * sizeof(float));
+    return lut;
+}
+
+void CmykLut::apply(const unsigned char* rgb, unsigned char* cmyk, size_t pixelCount) const {
+    const int n = size_;
+    const float step = static_cast<float>(n - 1) / 255.0f;
+    auto entry = [&](int ri, int gi, int bi) { return &table_[((static_cast<size_t>(bi) * n + gi) * n + ri) * 4]; };
+
+    for (size_t p = 0; p < pixelCount; ++p) {
+        float fr = rgb[p * 3] * step, fg = rgb[p * 3 + 1] * step, fb = rgb[p * 3 + 2] * step;
+        int r0 = std::min(static_cast<int>(fr), n - 2);
+        int g0 = std::min(static_cast<int>(fg), n - 2);
+        int b0 = std::min(static_cast<int>(fb), n - 2);
+        float dr = fr - r0, dg = fg - g0, db = fb - b0;
+
+        for (int ch = 0; ch < 4; ++ch) {
+            float c00 = entry(r0, g0, b0)[ch] * (1 - dr) + entry(r0 + 1, g0, b0)[ch] * dr;
+            float c10 = entry(r0, g0 + 1, b0)[ch] * (1 - dr) + entry(r0 + 1, g0 + 1, b0)[ch] * dr;
+            float c01 = entry(r0, g0, b0 + 1)[ch] * (1 - dr) + entry(r0 + 1, g0, b0 + 1)[ch] * dr;
+            float c11 = entry(r0, g0 + 1, b0 + 1)[ch] * (1 - dr) + entry(r0 + 1, g0 + 1, b0 + 1)[ch] * dr;
+            float value = (c00 * (1 - dg) + c10 * dg) * (1 - db) + (c01 * (1 - dg) + c11 * dg) * db;
+            cmyk[p * 4 + ch] = static_cast<unsigned char>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef COLOR_CONVERT_H
+#define COLOR_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief RGB to CMYK lookup table, sampled on a regular grid and trilinearly interpolated
+ *
+ * Lets conversions follow a press profile: sample the ICC transform once (e.g. with
+ * LittleCMS) into a table file and convert with it locally. The file format follows
+ * the .cube convention: a "LUT_3D_SIZE N" line, then N^3 lines of "c m y k" values in
+ * the 0-1 range with red varying fastest, then green, then blue. Lines starting with
+ * '#' are comments.
+ */
+class CmykLut {
+public:
+    /**
+     * @brief Load a table file
+     *
+     * @param path Path to the table file
+     * @return std::shared_ptr<const CmykLut> The table
+     * @throw std::runtime_error if the file cannot be read or is malformed
+     */
+    static std::shared_ptr<const CmykLut> load(const std::filesystem::path& path);
+
+    /**
+     * @brief Convert interleaved RGB pixels to interleaved CMYK
+     *
+     * @param rgb Source pixels, 3 bytes each
+     * @param cmyk Output pixels, 4 bytes each
+     * @param pixelCount Number of pixels
+     */
+    void apply(const unsigned char* rgb, unsigned char* cmyk, size_t pixelCount) const;
+
+    /**
+     * @brief Hash of the table contents, identifying it in persistent caches
+     */
+    std::uint64_t fingerprint() const { return fingerprint_; }
+
+private:
+    int size_ = 0;
+    std::uint64_t fingerprint_ = 0;
+    std::vector<float> table_; ///< size_^3 entries of 4 values, red fastest
+};
+
+/**
+ * @brief Convert interleaved RGB pixels to CMYK with full gray component replacement
+ *
+ * K = 1 - max(R, G, B) and C, M, Y are the remaining differences scaled by 1 / (1 - K),
+ * so neutrals print with black ink only. This is not what Pillow's convert('CMYK')
+ * does (C = 1 - R, M = 1 - G, Y = 1 - B with K = 0), so output differs from files
+ * converted that way; use a CmykLut to match a specific press profile.
+ *
+ * @param rgb Source pixels, 3 bytes each
+ * @param cmyk Output pixels, 4 bytes each
+ * @param pixelCount Number of pixels
+ */
+void rgb_to_cmyk(const unsigned char* rgb, unsigned char* cmyk, size_t pixelCount);
+
+#endif //COLOR_CONVERT_H
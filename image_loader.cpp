@@ -0,0 +1,497 @@
+#include "image_loader.h"
+#include "alpha_split.h"
+#include "card_utils.h"
+#include "resample.h"
+
+#include <png.h>
+#include <zlib.h>
+#include <cstdio> // jpeglib.h uses FILE without including it
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Walks the JPEG markers up to the frame header; the entropy-coded data is never touched.
+void parse_jpeg_header(const unsigned char* bytes, size_t size, PreparedImage& image) {
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        throw std::runtime_error("Not a JPEG file: " + image.sourcePath.string());
+    }
+
+    bool adobe = false;
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (bytes[pos] != 0xFF) {
+            break;
+        }
+        unsigned char marker = bytes[pos + 1];
+        if (marker == 0xFF) { // fill byte
+            pos++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) { // markers without a length
+            pos += 2;
+            continue;
+        }
+
+        size_t length = (bytes[pos + 2] << 8) | bytes[pos + 3];
+        if (length < 2 || pos + 2 + length > size) {
+            break;
+        }
+        const unsigned char* segment = &bytes[pos + 4];
+
+        if (marker == 0xEE && length >= 7 && std::memcmp(segment, "Adobe", 5) == 0) {
+            adobe = true;
+        }
+
+        // SOF0-SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+        bool isFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isFrame && length >= 8) {
+            image.bitsPerComponent = segment[0];
+            image.height = (segment[1] << 8) | segment[2];
+            image.width = (segment[3] << 8) | segment[4];
+            switch (segment[5]) {
+                case 1: image.colorSpace = PreparedImage::ColorSpace::Gray; break;
+                case 3: image.colorSpace = PreparedImage::ColorSpace::RGB; break;
+                case 4: image.colorSpace = PreparedImage::ColorSpace::CMYK; break;
+                default:
+                    throw std::runtime_error("Unsupported JPEG component count in " + image.sourcePath.string());
+            }
+            image.invertedCmyk = adobe && image.colorSpace == PreparedImage::ColorSpace::CMYK;
+            return;
+        }
+        if (marker == 0xDA) { // start of scan without a frame header
+            break;
+        }
+        pos += 2 + length;
+    }
+    throw std::runtime_error("Invalid JPEG header in " + image.sourcePath.string());
+}
+
+std::vector<unsigned char> convert_to_cmyk(const std::vector<unsigned char>& plane, size_t channels,
+                                           size_t pixelCount, const CmykLut* lut) {
+    const unsigned char* rgb = plane.data();
+    std::vector<unsigned char> expanded;
+    if (channels == 1) {
+        // Gray goes through the same conversion (plain formula: K only)
+        expanded.resize(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; ++i) {
+            expanded[i * 3] = expanded[i * 3 + 1] = expanded[i * 3 + 2] = plane[i];
+        }
+        rgb = expanded.data();
+    }
+
+    std::vector<unsigned char> cmyk(pixelCount * 4);
+    if (lut) {
+        lut->apply(rgb, cmyk.data(), pixelCount);
+    } else {
+        rgb_to_cmyk(rgb, cmyk.data(), pixelCount);
+    }
+    return cmyk;
+}
+
+// Collects the IDAT stream of PNGs that PDF can read without decoding: 8-bit gray or
+// RGB, not interlaced, without a tRNS chunk. The concatenated IDAT data is a complete
+// zlib stream and /DecodeParms with Predictor 15 undoes the PNG row filters. Returns
+// false (leaving the file to the decoder) for anything else.
+bool read_png_idat(const MappedFile& file, PreparedImage& image) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    const unsigned char* bytes = file.data();
+    const size_t size = file.size();
+    if (size < 8 || std::memcmp(bytes, signature, 8) != 0) {
+        return false;
+    }
+
+    auto be32 = [](const unsigned char* p) {
+        return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+    };
+
+    bool header = false;
+    std::vector<unsigned char> idat;
+    size_t pos = 8;
+    while (pos + 12 <= size) {
+        const size_t length = be32(bytes + pos);
+        const unsigned char* type = bytes + pos + 4;
+        const unsigned char* chunk = bytes + pos + 8;
+        if (length > size - pos - 12) {
+            return false;
+        }
+
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            // width, height, bit depth, color type, compression, filter, interlace
+            if (length < 13 || chunk[8] != 8 || (chunk[9] != 0 && chunk[9] != 2) || chunk[12] != 0) {
+                return false;
+            }
+            image.width = static_cast<int>(be32(chunk));
+            image.height = static_cast<int>(be32(chunk + 4));
+            image.colorSpace = chunk[9] == 2 ? PreparedImage::ColorSpace::RGB : PreparedImage::ColorSpace::Gray;
+            header = true;
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            return false; // color-key transparency needs a mask
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), chunk, chunk + length);
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + length;
+    }
+    if (!header || idat.empty() || image.width <= 0 || image.height <= 0) {
+        return false;
+    }
+
+    image.encoding = PreparedImage::Encoding::Flate;
+    image.pngPredictors = true;
+    image.data = std::move(idat);
+    return true;
+}
+
+// Pixel size at which the image reaches options.maxDpi when printed at its target size
+int max_pixels(float sizeMm, float maxDpi) {
+    return std::max(1, static_cast<int>(std::ceil(sizeMm / 25.4f * maxDpi)));
+}
+
+// Pixels beyond what the printer can resolve only cost file size and RIP time
+void limit_resolution(std::vector<unsigned char>& pixels, PreparedImage& image, int channels,
+                      const PrepareOptions& options) {
+    if (options.maxDpi <= 0.0f) {
+        return;
+    }
+    int width = std::min(image.width, max_pixels(options.targetWidthMm, options.maxDpi));
+    int height = std::min(image.height, max_pixels(options.targetHeightMm, options.maxDpi));
+    if (width < image.width || height < image.height) {
+        pixels = resample_area(pixels.data(), image.width, image.height, channels, width, height);
+        image.width = width;
+        image.height = height;
+    }
+}
+
+// libjpeg reports fatal errors through error_exit, which must not return: jump back to
+// the setjmp in the calling function with the message saved. Nothing with a destructor
+// may be created between the setjmp and the libjpeg calls it guards.
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr info) {
+    auto* errors = reinterpret_cast<JpegErrorManager*>(info->err);
+    info->err->format_message(info, errors->message);
+    std::longjmp(errors->jump, 1);
+}
+
+// Decodes to 8-bit RGB or gray (as many channels as the file has). Returns false with
+// the libjpeg message on failure.
+bool decode_jpeg(const MappedFile& file, std::vector<unsigned char>& pixels, int& width, int& height,
+                 int& channels, char* message) {
+    jpeg_decompress_struct info{};
+    JpegErrorManager errors{};
+    info.err = jpeg_std_error(&errors.base);
+    errors.base.error_exit = jpeg_error_exit;
+    if (setjmp(errors.jump)) {
+        jpeg_destroy_decompress(&info);
+        std::strcpy(message, errors.message);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, file.data(), static_cast<unsigned long>(file.size()));
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = info.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&info);
+
+    width = static_cast<int>(info.output_width);
+    height = static_cast<int>(info.output_height);
+    channels = info.output_components;
+    const size_t stride = static_cast<size_t>(width) * channels;
+    pixels.resize(stride * height);
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = pixels.data() + stride * info.output_scanline;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+// Encodes interleaved CMYK as an Adobe-style JPEG: the Adobe marker is written and the
+// samples are stored inverted, as Photoshop (and Pillow) do, so parse_jpeg_header()
+// reads it back as invertedCmyk. Returns false with the libjpeg message on failure.
+bool encode_cmyk_jpeg(const std::vector<unsigned char>& cmyk, int width, int height, int quality,
+                      std::vector<unsigned char>& out, char* message) {
+    jpeg_compress_struct info{};
+    JpegErrorManager errors{};
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    info.err = jpeg_std_error(&errors.base);
+    errors.base.error_exit = jpeg_error_exit;
+    if (setjmp(errors.jump)) {
+        jpeg_destroy_compress(&info);
+        std::free(buffer);
+        std::strcpy(message, errors.message);
+        return false;
+    }
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, &buffer, &size);
+    info.image_width = static_cast<JDIMENSION>(width);
+    info.image_height = static_cast<JDIMENSION>(height);
+    info.input_components = 4;
+    info.in_color_space = JCS_CMYK;
+    jpeg_set_defaults(&info);
+    jpeg_set_colorspace(&info, JCS_CMYK);
+    info.write_Adobe_marker = TRUE;
+    jpeg_set_quality(&info, quality, TRUE);
+    jpeg_start_compress(&info, TRUE);
+
+    const size_t stride = static_cast<size_t>(width) * 4;
+    out.resize(stride); // one inverted row at a time
+    while (info.next_scanline < info.image_height) {
+        const unsigned char* source = cmyk.data() + stride * info.next_scanline;
+        for (size_t i = 0; i < stride; ++i) {
+            out[i] = static_cast<unsigned char>(255 - source[i]);
+        }
+        JSAMPROW row = out.data();
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+
+    out.assign(buffer, buffer + size);
+    std::free(buffer);
+    return true;
+}
+
+// The DCT stream is embedded verbatim: only the header is parsed and the mapped file
+// itself becomes the payload, so no copy is made until libharu stores the stream.
+// With CMYK conversion, RGB and gray JPEGs are decoded, converted (and downsampled
+// like PNGs, since they are re-encoded anyway) and written back as CMYK JPEGs.
+PreparedImage prepare_jpeg(const fs::path& imagePath, std::shared_ptr<const MappedFile> file,
+                           const PrepareOptions& options) {
+    PreparedImage image;
+    image.sourcePath = imagePath;
+    image.encoding = PreparedImage::Encoding::DCT;
+    parse_jpeg_header(file->data(), file->size(), image);
+    if (!options.convertToCmyk || image.colorSpace == PreparedImage::ColorSpace::CMYK) {
+        image.mappingSize = file->size();
+        image.mapping = std::move(file);
+        return image;
+    }
+
+    // Good enough to keep a second generation of JPEG artifacts out of print
+    constexpr int cmykJpegQuality = 95;
+
+    std::vector<unsigned char> pixels;
+    int channels = 0;
+    char message[JMSG_LENGTH_MAX] = {};
+    if (!decode_jpeg(*file, pixels, image.width, image.height, channels, message)) {
+        throw std::runtime_error("Failed to decode JPEG " + imagePath.string() + ": " + message);
+    }
+    limit_resolution(pixels, image, channels, options);
+
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    pixels = convert_to_cmyk(pixels, static_cast<size_t>(channels), pixelCount, options.cmykLut.get());
+    if (!encode_cmyk_jpeg(pixels, image.width, image.height, cmykJpegQuality, image.data, message)) {
+        throw std::runtime_error("Failed to encode JPEG " + imagePath.string() + ": " + message);
+    }
+    image.bitsPerComponent = 8;
+    image.colorSpace = PreparedImage::ColorSpace::CMYK;
+    image.invertedCmyk = true;
+    return image;
+}
+
+PreparedImage prepare_png(const fs::path& imagePath, const MappedFile& file, const PrepareOptions& options,
+                          size_t deflateThreads) {
+    // Files that need no resampling or conversion skip the decode and re-encode
+    if (!options.convertToCmyk) {
+        PreparedImage image;
+        image.sourcePath = imagePath;
+        if (read_png_idat(file, image) &&
+            (options.maxDpi <= 0.0f ||
+             (image.width <= max_pixels(options.targetWidthMm, options.maxDpi) &&
+              image.height <= max_pixels(options.targetHeightMm, options.maxDpi)))) {
+            return image;
+        }
+    }
+
+    png_image png{};
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_memory(&png, file.data(), file.size())) {
+        throw std::runtime_error("Failed to read PNG " + imagePath.string() + ": " + png.message);
+    }
+
+    const bool color = png.format & PNG_FORMAT_FLAG_COLOR;
+    const bool alpha = png.format & PNG_FORMAT_FLAG_ALPHA;
+    png.format = color ? (alpha ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB)
+                       : (alpha ? PNG_FORMAT_GA : PNG_FORMAT_GRAY);
+
+    std::vector<unsigned char> pixels(PNG_IMAGE_SIZE(png));
+    if (!png_image_finish_read(&png, nullptr, pixels.data(), 0, nullptr)) {
+        std::string message = png.message;
+        png_image_free(&png);
+        throw std::runtime_error("Failed to decode PNG " + imagePath.string() + ": " + message);
+    }
+
+    PreparedImage image;
+    image.sourcePath = imagePath;
+    image.width = static_cast<int>(png.width);
+    image.height = static_cast<int>(png.height);
+    image.colorSpace = color ? PreparedImage::ColorSpace::RGB : PreparedImage::ColorSpace::Gray;
+    image.encoding = PreparedImage::Encoding::Flate;
+
+    const size_t colorChannels = color ? 3 : 1;
+
+    limit_resolution(pixels, image, static_cast<int>(colorChannels) + (alpha ? 1 : 0), options);
+
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+
+    // PDF has no interleaved alpha: split it into a separate soft mask image,
+    // which is dropped when every pixel is opaque
+    std::vector<unsigned char> colorPlane;
+    std::vector<unsigned char> alphaPlane;
+    bool hasMask = false;
+    if (alpha) {
+        colorPlane.resize(pixelCount * colorChannels);
+        alphaPlane.resize(pixelCount);
+        hasMask = !split_alpha(pixels.data(), colorChannels, pixelCount, colorPlane.data(), alphaPlane.data());
+    } else {
+        colorPlane = std::move(pixels);
+    }
+
+    if (options.convertToCmyk) {
+        colorPlane = convert_to_cmyk(colorPlane, colorChannels, pixelCount, options.cmykLut.get());
+        image.colorSpace = PreparedImage::ColorSpace::CMYK;
+    }
+
+    image.data = deflate_bytes(colorPlane.data(), colorPlane.size(), options.compressionLevel, deflateThreads);
+
+    if (hasMask) {
+        auto mask = std::make_shared<PreparedImage>();
+        mask->sourcePath = imagePath;
+        mask->width = image.width;
+        mask->height = image.height;
+        mask->colorSpace = PreparedImage::ColorSpace::Gray;
+        mask->encoding = PreparedImage::Encoding::Flate;
+        mask->data = deflate_bytes(alphaPlane.data(), alphaPlane.size(), options.compressionLevel, deflateThreads);
+        image.smask = std::move(mask);
+    }
+    return image;
+}
+
+// Raw deflate of data[begin, end) that continues the stream of the preceding chunk:
+// its window is primed with the previous 32 KiB and it ends on a byte boundary
+// (sync flush) unless it is the last chunk.
+std::vector<unsigned char> deflate_chunk(const unsigned char* data, size_t begin, size_t end, int level, bool last) {
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Failed to compress image data");
+    }
+    if (begin > 0) {
+        size_t dictionary = std::min<size_t>(begin, 32768);
+        deflateSetDictionary(&stream, data + begin - dictionary, static_cast<uInt>(dictionary));
+    }
+
+    // Room for the sync flush marker on top of the deflate bound
+    std::vector<unsigned char> out(deflateBound(&stream, static_cast<uLong>(end - begin)) + 16);
+    stream.next_in = const_cast<Bytef*>(data + begin);
+    stream.avail_in = static_cast<uInt>(end - begin);
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool ok = last ? result == Z_STREAM_END : (result == Z_OK && stream.avail_in == 0);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (!ok) {
+        throw std::runtime_error("Failed to compress image data");
+    }
+    return out;
+}
+
+} // namespace
+
+PreparedImage prepare_image(const fs::path& imagePath, const PrepareOptions& options, size_t deflateThreads) {
+    std::string ext = imagePath.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c){ return std::tolower(c); });
+    if (ext != ".jpg" && ext != ".jpeg" && ext != ".png") {
+        throw std::runtime_error("Unsupported image format: " + imagePath.string());
+    }
+
+    auto file = std::make_shared<const MappedFile>(imagePath);
+    std::uint64_t contentHash = options.hashContents ? hash_bytes(file->data(), file->size()) : 0;
+
+    PreparedImage image = ext == ".png" ? prepare_png(imagePath, *file, options, deflateThreads)
+                                        : prepare_jpeg(imagePath, file, options);
+    image.contentHash = contentHash;
+    return image;
+}
+
+std::vector<unsigned char> deflate_bytes(const unsigned char* data, size_t size, int level, size_t threads) {
+    // Chunks below this size lose more ratio to the flush markers than they gain in time
+    constexpr size_t minChunkSize = 256 * 1024;
+    size_t chunks = std::min(threads, size / minChunkSize);
+    if (chunks >= 2) {
+        size_t chunkSize = (size + chunks - 1) / chunks;
+        std::vector<std::future<std::pair<std::vector<unsigned char>, uLong>>> parts;
+        for (size_t begin = 0; begin < size; begin += chunkSize) {
+            size_t end = std::min(begin + chunkSize, size);
+            parts.push_back(std::async(std::launch::async, [=] {
+                return std::make_pair(deflate_chunk(data, begin, end, level, end == size),
+                                      adler32(1, data + begin, static_cast<uInt>(end - begin)));
+            }));
+        }
+
+        // zlib header: deflate with a 32 KiB window, FLEVEL matching the level, no dictionary
+        int flevel = level == Z_DEFAULT_COMPRESSION ? 2 : level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        unsigned int header = (0x78 << 8) | (flevel << 6);
+        header += 31 - header % 31;
+        std::vector<unsigned char> compressed{static_cast<unsigned char>(header >> 8),
+                                              static_cast<unsigned char>(header & 0xFF)};
+
+        uLong checksum = 1;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            auto [chunk, chunkChecksum] = parts[i].get();
+            size_t chunkLength = std::min(chunkSize, size - i * chunkSize);
+            compressed.insert(compressed.end(), chunk.begin(), chunk.end());
+            checksum = adler32_combine(checksum, chunkChecksum, static_cast<z_off_t>(chunkLength));
+        }
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            compressed.push_back(static_cast<unsigned char>(checksum >> shift));
+        }
+        return compressed;
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(size));
+    std::vector<unsigned char> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, data, static_cast<uLong>(size), level) != Z_OK) {
+        throw std::runtime_error("Failed to compress image data");
+    }
+    compressed.resize(compressedSize);
+    return compressed;
+}
+
+size_t ImageFileKeyHash::operator()(const ImageFileKey& key) const {
+    size_t h = std::hash<std::string>{}(key.path);
+    h ^= std::hash<std::uintmax_t>{}(key.size) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= std::hash<std::int64_t>{}(key.modified) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+ImageFileKey make_image_file_key(const fs::path& imagePath) {
+    return ImageFileKey{
+        fs::absolute(imagePath).lexically_normal().string(),
+        fs::file_size(imagePath),
+        static_cast<std::int64_t>(fs::last_write_time(imagePath).time_since_epoch().count())
+    };
+}
@@ -0,0 +1,120 @@
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include "MappedFile.h"
+#include "color_convert.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief An image converted into a stream that can be embedded as a PDF image XObject
+ *
+ * Produced off the PDF thread by prepare_image(); the payload is already encoded,
+ * so embedding it is a plain copy into the document. Passthrough images (JPEG) keep
+ * their source file mapped and use it directly as the payload; simple PNGs are
+ * embedded as their IDAT stream.
+ */
+struct PreparedImage {
+    enum class Encoding {
+        DCT,  ///< JPEG bytes, embedded unchanged with /DCTDecode
+        Flate ///< zlib-compressed samples, embedded with /FlateDecode
+    };
+
+    enum class ColorSpace {
+        Gray,
+        RGB,
+        CMYK
+    };
+
+    std::filesystem::path sourcePath;          ///< File the image was prepared from
+    int width = 0;                             ///< Width in pixels
+    int height = 0;                            ///< Height in pixels
+    int bitsPerComponent = 8;                  ///< Bits per color component
+    ColorSpace colorSpace = ColorSpace::RGB;   ///< Color space of the samples
+    Encoding encoding = Encoding::Flate;       ///< Encoding of data
+    bool invertedCmyk = false;                 ///< Adobe-style inverted CMYK JPEG (needs a /Decode array)
+    bool pngPredictors = false;                ///< Flate data keeps PNG row filters (needs /DecodeParms)
+    std::vector<unsigned char> data;           ///< Encoded stream payload (unless mapped)
+    std::shared_ptr<const MappedFile> mapping; ///< Mapped file holding the payload (instead of data)
+    size_t mappingOffset = 0;                  ///< Start of the payload in mapping
+    size_t mappingSize = 0;                    ///< Length of the payload in mapping
+    std::shared_ptr<PreparedImage> smask;      ///< Soft mask built from the alpha channel, if any
+    std::uint64_t contentHash = 0;             ///< Hash of the source file (when requested)
+
+    const unsigned char* payload() const { return mapping ? mapping->data() + mappingOffset : data.data(); } ///< Stream bytes
+    size_t payloadSize() const { return mapping ? mappingSize : data.size(); }                             ///< Stream length
+};
+
+/**
+ * @brief Options controlling how images are prepared
+ */
+struct PrepareOptions {
+    bool hashContents = false; ///< Fill PreparedImage::contentHash
+    float maxDpi = 0.0f;       ///< Downsample decoded images above this effective DPI (0 = never)
+    float targetWidthMm = 0.0f;  ///< Printed width of the image, used with maxDpi
+    float targetHeightMm = 0.0f; ///< Printed height of the image, used with maxDpi
+    bool convertToCmyk = false;  ///< Convert images to DeviceCMYK (RGB and gray JPEGs are re-encoded)
+    std::shared_ptr<const CmykLut> cmykLut; ///< Table for the CMYK conversion (nullptr = rgb_to_cmyk)
+    int compressionLevel = -1;   ///< zlib level for decoded images (0-9, -1 for the zlib default)
+
+    bool operator==(const PrepareOptions& other) const = default;
+};
+
+/**
+ * @brief Identifies one version of an image file: its path, size and modification time
+ */
+struct ImageFileKey {
+    std::string path;       ///< Absolute, normalized path
+    std::uintmax_t size;    ///< File size in bytes
+    std::int64_t modified;  ///< Last write time (clock ticks)
+
+    bool operator==(const ImageFileKey& other) const = default;
+};
+
+struct ImageFileKeyHash {
+    size_t operator()(const ImageFileKey& key) const;
+};
+
+/**
+ * @brief Build the key for the current version of a file
+ *
+ * @param imagePath Path to the image file
+ * @return ImageFileKey The key
+ * @throw std::filesystem::filesystem_error if the file does not exist
+ */
+ImageFileKey make_image_file_key(const std::filesystem::path& imagePath);
+
+/**
+ * @brief Read an image file and encode it for embedding
+ *
+ * Safe to call concurrently from several threads.
+ *
+ * @param imagePath Path to a .png, .jpg or .jpeg file
+ * @param options Preparation options
+ * @param deflateThreads Threads compressing a single large image, see deflate_bytes()
+ * @return PreparedImage The encoded image
+ * @throw std::runtime_error if the file cannot be read or is not a supported image
+ */
+PreparedImage prepare_image(const std::filesystem::path& imagePath, const PrepareOptions& options,
+                            size_t deflateThreads = 1);
+
+/**
+ * @brief Compress a buffer with zlib
+ *
+ * With several threads, large buffers are split into chunks that are deflated
+ * concurrently, each primed with the 32 KiB preceding it, and joined into one
+ * zlib stream (as pigz does). The output is slightly larger than a serial deflate.
+ *
+ * @param data Bytes to compress
+ * @param size Number of bytes
+ * @param level zlib compression level (-1 for the zlib default)
+ * @param threads Maximum number of chunks compressed at once
+ * @return std::vector<unsigned char> The zlib stream
+ */
+std::vector<unsigned char> deflate_bytes(const unsigned char* data, size_t size, int level, size_t threads = 1);
+
+#endif //IMAGE_LOADER_H
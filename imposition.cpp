@@ -0,0 +1,221 @@
+#include "imposition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// How many slots of a size fit in a length; the tolerance keeps exact fits
+// (e.g. 3 x 63 mm in 189 mm) from being lost to rounding
+int fit(float length, float slot) {
+    return length <= 0.0f ? 0 : static_cast<int>(std::floor(length / slot + 1e-4f));
+}
+
+// Lower is better among arrangements with the same number of slots
+int complexity(const Imposition &imposition) {
+    int score = static_cast<int>(imposition.blocks.size()) * 2;
+    for (const auto &block: imposition.blocks) {
+        score += block.rotated;
+    }
+    return score;
+}
+
+void consider(Imposition &best, Imposition candidate) {
+    std::erase_if(candidate.blocks, [](const ImpositionBlock &block) { return block.rows * block.columns == 0; });
+    if (candidate.cards() > best.cards() ||
+        (candidate.cards() == best.cards() && complexity(candidate) < complexity(best))) {
+        best = std::move(candidate);
+    }
+}
+
+constexpr float epsilon = 1e-3f;
+
+struct FreeRect {
+    float x, y, width, height;
+};
+
+struct SizeClass {
+    float width, height;
+    std::deque<size_t> items; ///< Not yet placed, in input order
+};
+
+// Best short side fit: the free rectangle leaving the smallest gap along either side.
+// Returns whether it found one that beats bestScore
+bool find_position(const std::vector<FreeRect> &free, float width, float height, size_t &bestIndex, float &bestScore) {
+    bool found = false;
+    for (size_t i = 0; i < free.size(); ++i) {
+        if (width <= free[i].width + epsilon && height <= free[i].height + epsilon) {
+            float score = std::min(free[i].width - width, free[i].height - height);
+            if (score < bestScore) {
+                bestScore = score;
+                bestIndex = i;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+// Places a slot in the top-left corner of a free rectangle and splits the rest with
+// two cuts, choosing the split that keeps the larger leftover rectangle biggest
+void place(std::vector<FreeRect> &free, size_t index, float width, float height, PackedSheet &sheet) {
+    FreeRect rect = free[index];
+    free.erase(free.begin() + static_cast<std::ptrdiff_t>(index));
+
+    float right = rect.width - width;
+    float below = rect.height - height;
+    float cutY = rect.y + below; // bottom edge of the slot
+    float cutX = rect.x + width; // right edge of the slot
+
+    bool horizontalFirst = std::max(rect.width * below, right * height) >= std::max(right * rect.height, width * below);
+    if (horizontalFirst) {
+        // Cut across the whole rectangle under the slot, then beside the slot
+        if (below > epsilon) {
+            sheet.cuts.push_back({rect.x, cutY, rect.x + rect.width, cutY});
+            free.push_back({rect.x, rect.y, rect.width, below});
+        }
+        if (right > epsilon) {
+            sheet.cuts.push_back({cutX, cutY, cutX, rect.y + rect.height});
+            free.push_back({cutX, cutY, right, height});
+        }
+    } else {
+        // Cut the whole height beside the slot, then under the slot
+        if (right > epsilon) {
+            sheet.cuts.push_back({cutX, rect.y, cutX, rect.y + rect.height});
+            free.push_back({cutX, rect.y, right, rect.height});
+        }
+        if (below > epsilon) {
+            sheet.cuts.push_back({rect.x, cutY, cutX, cutY});
+            free.push_back({rect.x, rect.y, width, below});
+        }
+    }
+}
+
+// Moves the packed slots to the middle of the page; cuts that ended on the page edge
+// still do, so they run edge to edge like the guide lines of a grid. Packing starts in
+// the top-left corner, so the left and top edges of the slots get their cuts here
+void centre(PackedSheet &sheet, float pageWidth, float pageHeight, float usedRight, float usedBottom) {
+    float dx = (pageWidth - usedRight) / 2;
+    float dy = -usedBottom / 2;
+    for (auto &slot: sheet.slots) {
+        slot.x += dx;
+        slot.y += dy;
+    }
+    auto moveX = [&](float x) { return x <= epsilon || x >= pageWidth - epsilon ? x : x + dx; };
+    auto moveY = [&](float y) { return y <= epsilon || y >= pageHeight - epsilon ? y : y + dy; };
+    for (auto &cut: sheet.cuts) {
+        if (cut.x0 == cut.x1) { // vertical
+            cut.x0 = cut.x1 = cut.x0 + dx;
+            cut.y0 = moveY(cut.y0);
+            cut.y1 = moveY(cut.y1);
+        } else {
+            cut.y0 = cut.y1 = cut.y0 + dy;
+            cut.x0 = moveX(cut.x0);
+            cut.x1 = moveX(cut.x1);
+        }
+    }
+    if (dx > epsilon) {
+        sheet.cuts.push_back({dx, 0.0f, dx, pageHeight});
+    }
+    if (dy < -epsilon) {
+        sheet.cuts.push_back({0.0f, pageHeight + dy, pageWidth, pageHeight + dy});
+    }
+}
+
+} // namespace
+
+Imposition solve_imposition(float pageWidth, float pageHeight, float slotWidth, float slotHeight) {
+    Imposition best;
+    if (slotWidth <= 0.0f || slotHeight <= 0.0f) {
+        return best;
+    }
+
+    // Upright rows on top, rotated rows in the height that is left (all upright or all
+    // rotated at the ends of the range)
+    for (int rows = fit(pageHeight, slotHeight); rows >= 0; --rows) {
+        float rest = pageHeight - rows * slotHeight;
+        consider(best, Imposition{{{rows, fit(pageWidth, slotWidth), false},
+                                   {fit(rest, slotWidth), fit(pageWidth, slotHeight), true}},
+                                  true});
+    }
+
+    // Upright columns on the left, rotated columns in the width that is left
+    for (int columns = fit(pageWidth, slotWidth); columns >= 0; --columns) {
+        float rest = pageWidth - columns * slotWidth;
+        consider(best, Imposition{{{fit(pageHeight, slotHeight), columns, false},
+                                   {fit(pageHeight, slotWidth), fit(rest, slotHeight), true}},
+                                  false});
+    }
+    return best;
+}
+
+std::vector<PackedSheet> pack_sheets(float pageWidth, float pageHeight,
+                                     const std::vector<std::pair<float, float>> &items, bool allowRotation) {
+    std::vector<SizeClass> classes;
+    std::map<std::pair<float, float>, size_t> classIndex;
+    for (size_t item = 0; item < items.size(); ++item) {
+        auto [it, inserted] = classIndex.try_emplace(items[item], classes.size());
+        if (inserted) {
+            auto [width, height] = items[item];
+            bool fits = (width <= pageWidth + epsilon && height <= pageHeight + epsilon) ||
+                        (allowRotation && height <= pageWidth + epsilon && width <= pageHeight + epsilon);
+            if (!fits) {
+                throw std::runtime_error("A card does not fit on the page with current settings");
+            }
+            classes.push_back({width, height, {}});
+        }
+        classes[it->second].items.push_back(item);
+    }
+    std::sort(classes.begin(), classes.end(), [](const SizeClass &a, const SizeClass &b) {
+        return a.width * a.height != b.width * b.height ? a.width * a.height > b.width * b.height
+                                                        : a.height > b.height;
+    });
+
+    std::vector<PackedSheet> sheets;
+    size_t remaining = items.size();
+    while (remaining > 0) {
+        PackedSheet sheet;
+        std::vector<FreeRect> free{{0.0f, 0.0f, pageWidth, pageHeight}};
+        float usedRight = 0.0f, usedBottom = pageHeight;
+
+        // Largest size that still fits anywhere, until nothing does
+        bool placed = true;
+        while (placed && remaining > 0) {
+            placed = false;
+            for (auto &sizeClass: classes) {
+                if (sizeClass.items.empty()) {
+                    continue;
+                }
+                size_t index = 0;
+                float score = pageWidth + pageHeight;
+                bool upright = find_position(free, sizeClass.width, sizeClass.height, index, score);
+                bool rotated = allowRotation && sizeClass.width != sizeClass.height &&
+                               find_position(free, sizeClass.height, sizeClass.width, index, score);
+                if (!upright && !rotated) {
+                    continue;
+                }
+
+                float width = rotated ? sizeClass.height : sizeClass.width;
+                float height = rotated ? sizeClass.width : sizeClass.height;
+                const FreeRect &rect = free[index];
+                sheet.slots.push_back({sizeClass.items.front(), rect.x, rect.y + rect.height - height, rotated});
+                usedRight = std::max(usedRight, rect.x + width);
+                usedBottom = std::min(usedBottom, rect.y + rect.height - height);
+                place(free, index, width, height, sheet);
+
+                sizeClass.items.pop_front();
+                remaining--;
+                placed = true;
+                break;
+            }
+        }
+
+        centre(sheet, pageWidth, pageHeight, usedRight, usedBottom);
+        sheets.push_back(std::move(sheet));
+    }
+    return sheets;
+}
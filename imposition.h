@@ -0,0 +1,92 @@
+#ifndef IMPOSITION_H
+#define IMPOSITION_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A uniform grid of card slots, part of an Imposition
+ */
+struct ImpositionBlock {
+    int rows = 0;
+    int columns = 0;
+    bool rotated = false; ///< Slots are turned 90 degrees (card width along the page height)
+};
+
+/**
+ * @brief Arrangement of card slots on a sheet: one grid, or two grids side by side
+ *
+ * With two blocks, the second uses the space the first leaves on the page, typically
+ * with the cards rotated, e.g. three rows of upright cards with a row of sideways
+ * cards underneath.
+ */
+struct Imposition {
+    std::vector<ImpositionBlock> blocks; ///< In fill order
+    bool stacked = true;                 ///< Blocks above one another (true) or side by side (false)
+
+    int cards() const {
+        int total = 0;
+        for (const auto &block: blocks) total += block.rows * block.columns;
+        return total;
+    }
+};
+
+/**
+ * @brief Find the arrangement that fits the most slots on a page
+ *
+ * Tries upright and rotated grids, and every split of the page between an upright
+ * band and a rotated band, stacked or side by side. Among arrangements with the same
+ * number of slots, a single grid is preferred over two, and upright over rotated.
+ *
+ * @param pageWidth Page width
+ * @param pageHeight Page height
+ * @param slotWidth Width of an upright slot (card plus bleed and border), same unit
+ * @param slotHeight Height of an upright slot
+ * @return Imposition The best arrangement; no blocks if not even one slot fits
+ */
+Imposition solve_imposition(float pageWidth, float pageHeight, float slotWidth, float slotHeight);
+
+/**
+ * @brief A slot placed by pack_sheets()
+ */
+struct PackedSlot {
+    size_t item = 0;      ///< Index into the items passed to pack_sheets()
+    float x = 0.0f;       ///< Left edge on the page
+    float y = 0.0f;       ///< Bottom edge on the page
+    bool rotated = false; ///< Placed turned 90 degrees (width and height swapped)
+};
+
+/**
+ * @brief One sheet of a packing
+ */
+struct PackedSheet {
+    struct Cut {
+        float x0, y0, x1, y1;
+    };
+
+    std::vector<PackedSlot> slots; ///< In the order they were placed
+    std::vector<Cut> cuts;         ///< Guillotine cuts separating the slots, edge to edge
+};
+
+/**
+ * @brief Pack slots of mixed sizes onto as few sheets as possible
+ *
+ * Guillotine packing: every placement splits a free rectangle with straight cuts
+ * from edge to edge, so the sheet can be cut apart with a guillotine cutter using
+ * exactly the returned cuts. Slots are grouped by size and placed largest first,
+ * each into the free rectangle that fits it most tightly; items of the same size keep
+ * their input order. Every sheet is centred on the page. Runs in time proportional to
+ * the number of items times the number of distinct sizes.
+ *
+ * @param pageWidth Page width
+ * @param pageHeight Page height
+ * @param items Size (width, height) of every slot, same unit as the page
+ * @param allowRotation Whether slots may be turned 90 degrees to fit
+ * @return std::vector<PackedSheet> Sheets in order; every item is on exactly one
+ * @throw std::runtime_error if an item does not fit on an empty page
+ */
+std::vector<PackedSheet> pack_sheets(float pageWidth, float pageHeight,
+                                     const std::vector<std::pair<float, float>> &items, bool allowRotation);
+
+#endif // IMPOSITION_H
@@ -0,0 +1,105 @@
+#ifndef JOB_MANIFEST_H
+#define JOB_MANIFEST_H
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "CardPDFGenerator.h"
+#include "settings_io.h"
+
+// One PDF to generate: the settings plus the paths passed to generatePDF.
+struct PdfJob {
+    CardPDFGenerator::Settings settings;
+    std::string frontImagesPath;
+    std::string backImagesPath;
+    std::string outputPath;
+};
+
+// Loads a batch job manifest.
+//
+// The manifest uses the same "key = value" lines as the settings file. Each "[job]"
+// line starts a new job; lines before the first one set defaults for all jobs. Besides
+// the settings keys, a job understands:
+//   settings = <file>   load a settings file (as written by save_settings)
+//   front = <path>      front images directory (required)
+//   back = <path>       back image file or directory
+//   output = <file>     PDF to write (required)
+// Relative paths are resolved against the manifest's directory. Blank lines and lines
+// starting with '#' are ignored.
+inline std::vector<PdfJob> load_job_manifest(const std::string& filename) {
+    std::ifstream ifs(filename);
+    if (!ifs) {
+        throw std::runtime_error("Could not open job manifest: " + filename);
+    }
+
+    const std::filesystem::path baseDir = std::filesystem::absolute(filename).parent_path();
+    auto resolve = [&](const std::string& path) {
+        std::filesystem::path p(path);
+        return (p.is_absolute() ? p : baseDir / p).string();
+    };
+
+    PdfJob defaults;
+    std::vector<PdfJob> jobs;
+    PdfJob* current = &defaults;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(ifs, line)) {
+        lineNumber++;
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#') continue;
+
+        if (line == "[job]") {
+            jobs.push_back(defaults);
+            current = &jobs.back();
+            continue;
+        }
+
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": expected 'key = value'");
+        }
+        std::string key = line.substr(0, separator);
+        key.erase(key.find_last_not_of(" \t") + 1);
+        std::string value = line.substr(separator + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+
+        if (key == "settings") {
+            std::string settingsFile = resolve(value);
+            if (!std::filesystem::is_regular_file(settingsFile)) {
+                throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": settings file not found: " + value);
+            }
+            try {
+                load_settings(current->settings, settingsFile);
+            } catch (const std::exception& e) {
+                throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": " + value + ": " + e.what());
+            }
+        }
+        else if (key == "front") current->frontImagesPath = resolve(value);
+        else if (key == "back") current->backImagesPath = resolve(value);
+        else if (key == "output") current->outputPath = resolve(value);
+        else {
+            bool known;
+            try {
+                known = apply_setting(current->settings, key, value);
+            } catch (const std::exception&) {
+                throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": invalid value for " + key);
+            }
+            if (!known) {
+                throw std::runtime_error(filename + ":" + std::to_string(lineNumber) + ": unknown key " + key);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].frontImagesPath.empty() || jobs[i].outputPath.empty()) {
+            throw std::runtime_error(filename + ": job " + std::to_string(i + 1) + " needs 'front' and 'output'");
+        }
+    }
+    return jobs;
+}
+
+#endif //JOB_MANIFEST_H
@@ -1,27 +1,143 @@
 #include "CardPDFGenerator.h"
+#include "PreparedImageStore.h"
+#include "job_manifest.h"
+#include "settings_io.h"
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
+// Headless entry point: generates one PDF from command line options, or a batch of PDFs
+// from job manifests (see job_manifest.h). Prepared images are shared by all jobs of a run.
 
-int main() {
-    CardPDFGenerator::Settings settings;
-    settings.cardWidth = 63.5f;    // mm
-    settings.cardHeight = 88.0f;   // mm
-    settings.bleed = 1.5f;         // mm
-    settings.hasBorder = false;
-    settings.borderWidth = 0.0f;   // mm
-    settings.borderColor = {0.0f, 0.0f, 0.0f};  // Black
-    settings.rows = 3;
-    settings.columns = 3;
-    settings.showGuideLines = false;
-    settings.guideLineWidth = 0.2f;  // mm
-    settings.backMode = CardPDFGenerator::BackMode::SameBack;
+static void print_usage(const char* program) {
+    std::cerr << "Usage:\n"
+              << "  " << program << " [options] <manifest>...\n"
+              << "  " << program << " [options] --front <dir> --output <file> [--back <path>] [--settings <file>]\n"
+              << "\nOptions:\n"
+              << "  --cache-mb <n>   Memory for prepared images shared between jobs (default 1024)\n"
+              << "  --stats <file>   Write per-phase timings and counters of all jobs as JSON\n"
+              << "  --trace <file>   Write a Chrome trace (chrome://tracing, Perfetto) of all jobs\n";
+}
 
+int main(int argc, char** argv) {
+    std::vector<std::string> manifests;
+    PdfJob single;
+    bool hasSingle = false;
+    long long cacheMb = 1024;
+    std::string statsPath;
+    std::string tracePath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg == "--settings") {
+            // load_settings() falls back to the defaults for a missing file, which suits the UI only
+            std::string settingsFile = value();
+            if (!std::filesystem::is_regular_file(settingsFile)) {
+                std::cerr << "Settings file not found: " << settingsFile << std::endl;
+                return 1;
+            }
+            try {
+                load_settings(single.settings, settingsFile);
+            } catch (const std::exception& e) {
+                std::cerr << "Invalid settings file " << settingsFile << ": " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--front") {
+            single.frontImagesPath = value();
+            hasSingle = true;
+        } else if (arg == "--back") {
+            single.backImagesPath = value();
+        } else if (arg == "--output") {
+            single.outputPath = value();
+        } else if (arg == "--cache-mb") {
+            std::string text = value();
+            size_t parsed = 0;
+            try {
+                cacheMb = std::stoll(text, &parsed);
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed != text.size() || cacheMb < 0) {
+                std::cerr << "Invalid value for --cache-mb (expected a size in MiB of 0 or more): " << text << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            statsPath = value();
+        } else if (arg == "--trace") {
+            tracePath = value();
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            manifests.push_back(arg);
+        }
+    }
+
+    std::vector<PdfJob> jobs;
     try {
-        CardPDFGenerator generator(settings);
-        generator.generatePDF("output.pdf", "front_images/", "back.png");
+        if (hasSingle) {
+            if (single.outputPath.empty()) {
+                throw std::runtime_error("--output is required with --front");
+            }
+            jobs.push_back(single);
+        } else if (!single.outputPath.empty() || !single.backImagesPath.empty()) {
+            throw std::runtime_error("--front is required with --output or --back");
+        }
+        for (const auto& manifest : manifests) {
+            std::vector<PdfJob> manifestJobs = load_job_manifest(manifest);
+            jobs.insert(jobs.end(), manifestJobs.begin(), manifestJobs.end());
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-    return 0;
-}
\ No newline at end of file
+
+    if (jobs.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    auto imageStore = std::make_shared<PreparedImageStore>(static_cast<std::uint64_t>(cacheMb) * 1024 * 1024);
+    std::shared_ptr<Instrumentation> instrumentation;
+    if (!statsPath.empty() || !tracePath.empty()) {
+        instrumentation = std::make_shared<Instrumentation>();
+    }
+    int failures = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const PdfJob& job = jobs[i];
+        try {
+            CardPDFGenerator generator(job.settings, imageStore);
+            generator.setInstrumentation(instrumentation);
+            generator.generatePDF(job.outputPath, job.frontImagesPath, job.backImagesPath);
+            std::cout << "[" << (i + 1) << "/" << jobs.size() << "] Wrote " << job.outputPath << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "[" << (i + 1) << "/" << jobs.size() << "] Error (" << job.outputPath << "): "
+                      << e.what() << std::endl;
+            failures++;
+        }
+    }
+
+    try {
+        if (!statsPath.empty()) instrumentation->writeJson(statsPath);
+        if (!tracePath.empty()) instrumentation->writeChromeTrace(tracePath);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include "resample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Source pixels covering one output pixel along an axis, with their coverage weights
+struct Span {
+    int first;
+    std::vector<float> weights;
+};
+
+std::vector<Span> build_spans(int srcSize, int dstSize) {
+    std::vector<Span> spans(dstSize);
+    const double scale = static_cast<double>(srcSize) / dstSize;
+    for (int d = 0; d < dstSize; ++d) {
+        double start = d * scale;
+        double end = std::min<double>((d + 1) * scale, srcSize);
+        int first = static_cast<int>(start);
+        int last = std::min(static_cast<int>(std::ceil(end)), srcSize);
+
+        Span& span = spans[d];
+        span.first = first;
+        for (int s = first; s < last; ++s) {
+            double coverage = std::min<double>(s + 1, end) - std::max<double>(s, start);
+            span.weights.push_back(static_cast<float>(coverage / scale));
+        }
+    }
+    return spans;
+}
+
+// acc[i] += weight * row[i]: the hot loop of the vertical pass, over whole rows
+void accumulate_row(float* acc, const unsigned char* row, size_t count, float weight) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 w = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i));
+        __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(values, w));
+        _mm256_storeu_ps(acc + i, sum);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 w = _mm_set1_ps(weight);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        int packed;
+        std::memcpy(&packed, row + i, sizeof(packed));
+        __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+        __m128 values = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(values, w));
+        _mm_storeu_ps(acc + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        acc[i] += weight * row[i];
+    }
+}
+
+// As accumulate_row(), for pixels whose last channel is alpha: the colour channels are
+// weighted by their alpha (premultiplied), so transparent pixels add no colour
+void accumulate_row_premultiplied(float* acc, const unsigned char* row, size_t pixels, int channels, float weight) {
+    const int alpha = channels - 1;
+    for (size_t p = 0; p < pixels; ++p, row += channels, acc += channels) {
+        float coverage = weight * row[alpha];
+        for (int c = 0; c < alpha; ++c) {
+            acc[c] += coverage * row[c];
+        }
+        acc[alpha] += coverage;
+    }
+}
+
+} // namespace
+
+std::vector<unsigned char> resample_area(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+                                         int dstWidth, int dstHeight) {
+    if (dstWidth <= 0 || dstHeight <= 0 || dstWidth > srcWidth || dstHeight > srcHeight) {
+        throw std::invalid_argument("resample_area only reduces image size");
+    }
+
+    const std::vector<Span> columns = build_spans(srcWidth, dstWidth);
+    const std::vector<Span> rows = build_spans(srcHeight, dstHeight);
+    const size_t srcStride = static_cast<size_t>(srcWidth) * channels;
+    const size_t dstStride = static_cast<size_t>(dstWidth) * channels;
+
+    std::vector<unsigned char> dst(dstStride * dstHeight);
+    std::vector<float> acc(srcStride);
+    const bool hasAlpha = channels == 2 || channels == 4;
+    auto to_byte = [](float value) { return static_cast<unsigned char>(std::clamp(value + 0.5f, 0.0f, 255.0f)); };
+
+    for (int y = 0; y < dstHeight; ++y) {
+        // Vertical pass: blend the source rows under this output row
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        const Span& rowSpan = rows[y];
+        for (size_t k = 0; k < rowSpan.weights.size(); ++k) {
+            const unsigned char* row = src + (rowSpan.first + k) * srcStride;
+            if (hasAlpha) {
+                accumulate_row_premultiplied(acc.data(), row, srcWidth, channels, rowSpan.weights[k]);
+            } else {
+                accumulate_row(acc.data(), row, srcStride, rowSpan.weights[k]);
+            }
+        }
+
+        // Horizontal pass: blend the columns under each output pixel
+        unsigned char* out = dst.data() + y * dstStride;
+        for (int x = 0; x < dstWidth; ++x) {
+            const Span& colSpan = columns[x];
+            unsigned char* pixel = out + x * channels;
+            float sums[4] = {};
+            for (int c = 0; c < channels; ++c) {
+                float sum = 0.0f;
+                const float* in = acc.data() + static_cast<size_t>(colSpan.first) * channels + c;
+                for (size_t k = 0; k < colSpan.weights.size(); ++k) {
+                    sum += colSpan.weights[k] * in[k * channels];
+                }
+                if (hasAlpha) {
+                    sums[c] = sum;
+                } else {
+                    pixel[c] = to_byte(sum);
+                }
+            }
+            if (hasAlpha) {
+                // Back to straight alpha; a fully transparent pixel has no colour to keep
+                const int alpha = channels - 1;
+                for (int c = 0; c < alpha; ++c) {
+                    pixel[c] = to_byte(sums[alpha] > 0.0f ? sums[c] / sums[alpha] : 0.0f);
+                }
+                pixel[alpha] = to_byte(sums[alpha]);
+            }
+        }
+    }
+    return dst;
+}
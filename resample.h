@@ -0,0 +1,27 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <vector>
+
+/**
+ * @brief Downscale 8-bit interleaved pixels with an area (box) filter
+ *
+ * Each output pixel is the coverage-weighted average of the source pixels under it,
+ * which is alias-free for any reduction factor. The axes are scaled independently.
+ *
+ * With 2 or 4 channels the last one is taken to be (straight) alpha, and the colour is
+ * averaged weighted by it, so transparent pixels do not bleed their colour into the
+ * edges of opaque ones.
+ *
+ * @param src Source pixels, rows packed without padding
+ * @param srcWidth Source width in pixels
+ * @param srcHeight Source height in pixels
+ * @param channels Bytes per pixel
+ * @param dstWidth Output width in pixels (at most srcWidth)
+ * @param dstHeight Output height in pixels (at most srcHeight)
+ * @return std::vector<unsigned char> The resampled pixels
+ */
+std::vector<unsigned char> resample_area(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+                                         int dstWidth, int dstHeight);
+
+#endif //RESAMPLE_H
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 #include "CardPDFGenerator.h"
 
 // Helper to write a setting to the file
@@ -32,6 +33,7 @@ inline void save_settings(const CardPDFGenerator::Settings& settings, const std:
     write_setting(ofs, "bleed", settings.bleed);
     write_setting(ofs, "rows", settings.rows);
     write_setting(ofs, "columns", settings.columns);
+    write_setting(ofs, "autoImpose", settings.autoImpose);
     write_setting(ofs, "hasBorder", settings.hasBorder);
     write_setting(ofs, "borderWidth", settings.borderWidth);
     write_setting(ofs, "borderColor_r", settings.borderColor.r);
@@ -40,9 +42,68 @@ inline void save_settings(const CardPDFGenerator::Settings& settings, const std:
     write_setting(ofs, "guideLineWidth", settings.guideLineWidth);
     write_setting(ofs, "showGuideLines", settings.showGuideLines);
     write_setting(ofs, "backMode", static_cast<int>(settings.backMode));
+    write_setting(ofs, "duplexMode", static_cast<int>(settings.duplexMode));
+    write_setting(ofs, "backOffsetX", settings.backOffsetX);
+    write_setting(ofs, "backOffsetY", settings.backOffsetY);
+    write_setting(ofs, "backRotation", settings.backRotation);
+    write_setting(ofs, "dedupeByContent", settings.dedupeByContent);
+    write_setting(ofs, "workerThreads", settings.workerThreads);
+    write_setting(ofs, "spoolImages", settings.spoolImages);
+    write_setting(ofs, "memoryBudgetMb", settings.memoryBudgetMb);
+    write_setting(ofs, "maxImageDpi", settings.maxImageDpi);
+    write_setting(ofs, "convertToCmyk", settings.convertToCmyk);
+    write_setting(ofs, "cmykLutPath", settings.cmykLutPath);
+    write_setting(ofs, "copiesPerCard", settings.copiesPerCard);
+    write_setting(ofs, "compressionLevel", settings.compressionLevel);
+    write_setting(ofs, "sheetsPerFile", settings.sheetsPerFile);
+    write_setting(ofs, "shardSheets", settings.shardSheets);
+    write_setting(ofs, "incremental", settings.incremental);
+    write_setting(ofs, "diskCachePath", settings.diskCachePath);
+    write_setting(ofs, "diskCacheMb", settings.diskCacheMb);
 }
 
-// Loads settings from a text file into the settings struct.
+// Applies a single "key = value" setting. Returns false if the key is unknown.
+inline bool apply_setting(CardPDFGenerator::Settings& settings, const std::string& key, const std::string& value) {
+    if (key == "pageWidth") settings.pageWidth = std::stof(value);
+    else if (key == "pageHeight") settings.pageHeight = std::stof(value);
+    else if (key == "cardWidth") settings.cardWidth = std::stof(value);
+    else if (key == "cardHeight") settings.cardHeight = std::stof(value);
+    else if (key == "bleed") settings.bleed = std::stof(value);
+    else if (key == "rows") settings.rows = std::stoi(value);
+    else if (key == "columns") settings.columns = std::stoi(value);
+    else if (key == "autoImpose") settings.autoImpose = std::stoi(value);
+    else if (key == "hasBorder") settings.hasBorder = std::stoi(value);
+    else if (key == "borderWidth") settings.borderWidth = std::stof(value);
+    else if (key == "borderColor_r") settings.borderColor.r = std::stof(value);
+    else if (key == "borderColor_g") settings.borderColor.g = std::stof(value);
+    else if (key == "borderColor_b") settings.borderColor.b = std::stof(value);
+    else if (key == "guideLineWidth") settings.guideLineWidth = std::stof(value);
+    else if (key == "showGuideLines") settings.showGuideLines = std::stoi(value);
+    else if (key == "backMode") settings.backMode = static_cast<CardPDFGenerator::BackMode>(std::stoi(value));
+    else if (key == "duplexMode") settings.duplexMode = static_cast<CardPDFGenerator::DuplexMode>(std::stoi(value));
+    else if (key == "backOffsetX") settings.backOffsetX = std::stof(value);
+    else if (key == "backOffsetY") settings.backOffsetY = std::stof(value);
+    else if (key == "backRotation") settings.backRotation = std::stof(value);
+    else if (key == "dedupeByContent") settings.dedupeByContent = std::stoi(value);
+    else if (key == "workerThreads") settings.workerThreads = std::stoi(value);
+    else if (key == "spoolImages") settings.spoolImages = std::stoi(value);
+    else if (key == "memoryBudgetMb") settings.memoryBudgetMb = std::stoi(value);
+    else if (key == "maxImageDpi") settings.maxImageDpi = std::stof(value);
+    else if (key == "convertToCmyk") settings.convertToCmyk = std::stoi(value);
+    else if (key == "cmykLutPath") settings.cmykLutPath = value;
+    else if (key == "copiesPerCard") settings.copiesPerCard = std::stoi(value);
+    else if (key == "compressionLevel") settings.compressionLevel = std::stoi(value);
+    else if (key == "sheetsPerFile") settings.sheetsPerFile = std::stoi(value);
+    else if (key == "shardSheets") settings.shardSheets = std::stoi(value);
+    else if (key == "incremental") settings.incremental = std::stoi(value);
+    else if (key == "diskCachePath") settings.diskCachePath = value;
+    else if (key == "diskCacheMb") settings.diskCacheMb = std::stoi(value);
+    else return false;
+    return true;
+}
+
+// Loads settings from a text file into the settings struct. Throws std::runtime_error
+// naming the key if a value does not parse.
 inline void load_settings(CardPDFGenerator::Settings& settings, const std::string& filename) {
     std::ifstream ifs(filename);
     if (!ifs) {
@@ -59,22 +120,11 @@ inline void load_settings(CardPDFGenerator::Settings& settings, const std::strin
             std::string value_str;
             if (std::getline(iss, value_str)) {
                 value_str.erase(0, value_str.find_first_not_of(" \t"));
-
-                if (key == "pageWidth") settings.pageWidth = std::stof(value_str);
-                else if (key == "pageHeight") settings.pageHeight = std::stof(value_str);
-                else if (key == "cardWidth") settings.cardWidth = std::stof(value_str);
-                else if (key == "cardHeight") settings.cardHeight = std::stof(value_str);
-                else if (key == "bleed") settings.bleed = std::stof(value_str);
-                else if (key == "rows") settings.rows = std::stoi(value_str);
-                else if (key == "columns") settings.columns = std::stoi(value_str);
-                else if (key == "hasBorder") settings.hasBorder = std::stoi(value_str);
-                else if (key == "borderWidth") settings.borderWidth = std::stof(value_str);
-                else if (key == "borderColor_r") settings.borderColor.r = std::stof(value_str);
-                else if (key == "borderColor_g") settings.borderColor.g = std::stof(value_str);
-                else if (key == "borderColor_b") settings.borderColor.b = std::stof(value_str);
-                else if (key == "guideLineWidth") settings.guideLineWidth = std::stof(value_str);
-                else if (key == "showGuideLines") settings.showGuideLines = std::stoi(value_str);
-                else if (key == "backMode") settings.backMode = static_cast<CardPDFGenerator::BackMode>(std::stoi(value_str));
+                try {
+                    apply_setting(settings, key, value_str);
+                } catch (const std::logic_error&) { // std::stoi and std::stof
+                    throw std::runtime_error("invalid value for " + key + ": " + value_str);
+                }
             }
         }
     }
@@ -10,15 +10,18 @@
 #include "clay.h"
 #include "renderers/raylib/clay_renderer_raylib.c"
 #include "clay_utils.h"
-#include "card_utils.h"
 
 #include "CardPDFGenerator.h"
+#include "SheetPreview.h"
 #include "settings_io.h"
 
 #include <string>
 #include <cstring> // Required for strlen
 #include <cstdio>  // Required for snprintf
 #include <map>
+#include <future>
+#include <memory>
+#include <thread>
 
 // --- UI State & Helper Data ---
 
@@ -32,12 +35,99 @@ struct UIState {
     char outputPath[256] = "output.pdf";
     int activeTextInput = -1; // -1 for none, 0 for front, 1 for back, 2 for output
     char statusMessage[256] = "Ready";
-    char duplicateSourcePath[256] = "source/";
-    char duplicateDestinationPath[256] = "copies/";
-    int duplicateCount = 2;
     Color statusColor = LIME;
 };
 
+/**
+ * @struct GenerationJob
+ * @brief A PDF being generated on a background thread.
+ *
+ * The generator is declared first so the future (whose destructor waits for the
+ * thread) is destroyed before it.
+ */
+struct GenerationJob {
+    std::unique_ptr<CardPDFGenerator> generator;
+    std::future<void> result;
+
+    bool running() const { return result.valid(); }
+};
+
+/**
+ * @brief Starts generating a PDF on a background thread.
+ * @param job The job to start; must not be running.
+ * @param settings The settings to generate with (copied by the generator).
+ * @param imageStore Prepared images kept between runs, so only edited images are encoded again.
+ * @param uiState The UI state holding the paths and receiving the status message.
+ */
+void StartGeneration(GenerationJob* job, const CardPDFGenerator::Settings& settings,
+                     std::shared_ptr<PreparedImageStore> imageStore, UIState* uiState) {
+    try {
+        job->generator = std::make_unique<CardPDFGenerator>(settings, std::move(imageStore));
+    } catch (const std::exception& e) {
+        snprintf(uiState->statusMessage, sizeof(uiState->statusMessage), "Error: %s", e.what());
+        uiState->statusColor = RED;
+        return;
+    }
+    job->result = std::async(std::launch::async,
+        [generator = job->generator.get(), output = std::string(uiState->outputPath),
+         front = std::string(uiState->frontImagesPath), back = std::string(uiState->backImagesPath)] {
+            generator->generatePDF(output, front, back);
+        });
+    strcpy(uiState->statusMessage, "Starting...");
+    uiState->statusColor = DARKGRAY;
+}
+
+/**
+ * @brief Updates the status message from a running job and collects its result once finished.
+ * @param job The job to poll.
+ * @param uiState The UI state receiving the status message.
+ */
+void PollGeneration(GenerationJob* job, UIState* uiState) {
+    if (!job->running()) return;
+
+    if (job->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            job->result.get();
+            CardPDFGenerator::Progress progress = job->generator->progress();
+            double peakMb = progress.peakImageBytes / 1048576.0;
+            if (progress.filesSkipped > 0) {
+                snprintf(uiState->statusMessage, sizeof(uiState->statusMessage),
+                         "Success! %zu unchanged file(s) kept, peak image memory %.0f MB.",
+                         progress.filesSkipped, peakMb);
+            } else {
+                snprintf(uiState->statusMessage, sizeof(uiState->statusMessage),
+                         "Success! PDF generated, peak image memory %.0f MB.", peakMb);
+            }
+            uiState->statusColor = LIME;
+        } catch (const CardPDFGenerator::Cancelled&) {
+            strcpy(uiState->statusMessage, "Generation cancelled.");
+            uiState->statusColor = ORANGE;
+        } catch (const std::exception& e) {
+            snprintf(uiState->statusMessage, sizeof(uiState->statusMessage), "Error: %s", e.what());
+            uiState->statusColor = RED;
+        }
+        job->generator.reset();
+        return;
+    }
+
+    CardPDFGenerator::Progress progress = job->generator->progress();
+    switch (progress.phase) {
+        case CardPDFGenerator::Phase::Layout:
+            snprintf(uiState->statusMessage, sizeof(uiState->statusMessage), "Placing cards... %zu / %zu",
+                     progress.cardsDone, progress.cardsTotal);
+            break;
+        case CardPDFGenerator::Phase::Saving:
+        case CardPDFGenerator::Phase::Done:
+            snprintf(uiState->statusMessage, sizeof(uiState->statusMessage), "Saving... %.1f / %.1f MB",
+                     progress.bytesWritten / 1048576.0, progress.bytesTotal / 1048576.0);
+            break;
+        default:
+            strcpy(uiState->statusMessage, "Reading images...");
+            break;
+    }
+    uiState->statusColor = DARKGRAY;
+}
+
 /**
  * @brief Creates a Clay_String from a C-style string.
  * @param c_str The null-terminated C-style string.
@@ -381,7 +471,7 @@ void GuiIntInput(Clay_ElementId id, int* value, int min, int max, int inputId, i
 
 // --- Main Application ---
 int main() {
-    const int screenWidth = 900; // Increased width for better layout
+    const int screenWidth = 1500; // Settings on the left, sheet preview on the right
     const int screenHeight = 1050; // Increased height
 
     // --- Initialization ---
@@ -400,8 +490,17 @@ int main() {
     Font fonts[1];
     fonts[0] = LoadFont("fonts/static/FunnelDisplay-Light.ttf");
 
+    GenerationJob generationJob;
+    auto imageStore = std::make_shared<PreparedImageStore>(256ull * 1024 * 1024);
+    // Half the cores for thumbnails, leaving the rest to a PDF being generated at the same time
+    auto preview = std::make_unique<SheetPreview>(std::max(1u, std::thread::hardware_concurrency() / 2));
+
     // --- Main Loop ---
     while (!WindowShouldClose()) {
+        PollGeneration(&generationJob, &uiState);
+        preview->update(settings, uiState.frontImagesPath);
+        preview->uploadThumbnails();
+
         // Update Clay layout and input state
         Clay_SetLayoutDimensions((Clay_Dimensions){(float)GetScreenWidth(), (float)GetScreenHeight()});
         Clay_SetPointerState(RAYLIB_VECTOR2_TO_CLAY_VECTOR2(GetMousePosition()), IsMouseButtonDown(MOUSE_BUTTON_LEFT));
@@ -434,7 +533,7 @@ int main() {
                 // Left Column: Page and Card Dimensions
                 CLAY({
                     .layout = {
-                        .sizing = {CLAY_SIZING_PERCENT(0.5)},
+                        .sizing = {CLAY_SIZING_PERCENT(0.3)},
                         .childGap = 10,
                         .layoutDirection = CLAY_TOP_TO_BOTTOM
                     }
@@ -451,6 +550,7 @@ int main() {
                     CLAY_TEXT(CLAY_STRING("Grid Layout"), CLAY_TEXT_CONFIG({.textColor={100,100,100,255}, .fontSize=20}));
                     GuiSliderInt(CLAY_ID("rows"), "Rows", &settings.rows, 1, 10, &uiState);
                     GuiSliderInt(CLAY_ID("columns"), "Columns", &settings.columns, 1, 10, &uiState);
+                    GuiCheckbox(CLAY_ID("autoImpose"), "Auto Layout (ignores rows/columns)", &settings.autoImpose);
 
                     // --- Back Mode & File Paths Section ---
                     CLAY({
@@ -472,6 +572,19 @@ int main() {
                             bool uniqueBack = settings.backMode == CardPDFGenerator::BackMode::UniqueBack;
                             if (GuiButton(CLAY_ID("uniqueBack"), uniqueBack ? "[ Unique Backs ]" : "Unique Backs")) settings.backMode = CardPDFGenerator::BackMode::UniqueBack;
                         }
+                        CLAY({.layout = {.childGap = 10}}) {
+                            bool longEdge = settings.duplexMode == CardPDFGenerator::DuplexMode::LongEdge;
+                            if (GuiButton(CLAY_ID("longEdge"), longEdge ? "[ Long Edge ]" : "Long Edge")) settings.duplexMode = CardPDFGenerator::DuplexMode::LongEdge;
+
+                            bool shortEdge = settings.duplexMode == CardPDFGenerator::DuplexMode::ShortEdge;
+                            if (GuiButton(CLAY_ID("shortEdge"), shortEdge ? "[ Short Edge ]" : "Short Edge")) settings.duplexMode = CardPDFGenerator::DuplexMode::ShortEdge;
+
+                            bool noDuplex = settings.duplexMode == CardPDFGenerator::DuplexMode::None;
+                            if (GuiButton(CLAY_ID("noDuplex"), noDuplex ? "[ No Mirroring ]" : "No Mirroring")) settings.duplexMode = CardPDFGenerator::DuplexMode::None;
+                        }
+                        GuiSliderFloat(CLAY_ID("backOffsetX"), "Back Offset X", &settings.backOffsetX, -5.0f, 5.0f, &uiState);
+                        GuiSliderFloat(CLAY_ID("backOffsetY"), "Back Offset Y", &settings.backOffsetY, -5.0f, 5.0f, &uiState);
+                        GuiSliderFloat(CLAY_ID("backRotation"), "Back Rotation", &settings.backRotation, -2.0f, 2.0f, &uiState);
 
                         CLAY({.layout={.sizing={.height=CLAY_SIZING_FIXED(5)}}}){}; // Spacer
 
@@ -481,10 +594,10 @@ int main() {
                     }
                 }
 
-                // Right Column: Appearance and Color
+                // Middle Column: Appearance and Color
                 CLAY({
                     .layout = {
-                        .sizing = {CLAY_SIZING_PERCENT(0.5)},
+                        .sizing = {CLAY_SIZING_PERCENT(0.3)},
                         .childGap = 15,
                         .layoutDirection = CLAY_TOP_TO_BOTTOM
                     }
@@ -494,6 +607,12 @@ int main() {
                     GuiSliderFloat(CLAY_ID("guideLineWidth"), "Guide Width", &settings.guideLineWidth, 0.0f, 2.0f, &uiState);
                     GuiCheckbox(CLAY_ID("hasBorder"), "Has Border", &settings.hasBorder);
                     GuiSliderFloat(CLAY_ID("borderWidth"), "Border Width", &settings.borderWidth, 0.0f, 10.0f, &uiState);
+                    GuiCheckbox(CLAY_ID("dedupeByContent"), "Merge Identical Images", &settings.dedupeByContent);
+                    GuiCheckbox(CLAY_ID("spoolImages"), "Low Memory Mode", &settings.spoolImages);
+                    GuiCheckbox(CLAY_ID("convertToCmyk"), "Convert to CMYK", &settings.convertToCmyk);
+                    GuiCheckbox(CLAY_ID("incremental"), "Skip Unchanged Files", &settings.incremental);
+                    GuiSliderInt(CLAY_ID("compressionLevel"), "Compression Level (-1 = default)", &settings.compressionLevel, -1, 9, &uiState);
+                    GuiSliderFloat(CLAY_ID("maxImageDpi"), "Max Image DPI (0 = native)", &settings.maxImageDpi, 0.0f, 1200.0f, &uiState, true);
 
                     CLAY({.layout={.sizing={.height=CLAY_SIZING_FIXED(5)}}}){}; // Spacer
 
@@ -504,21 +623,33 @@ int main() {
 
                     CLAY({.layout={.sizing={.height=CLAY_SIZING_FIXED(5)}}}){}; // Spacer
 
-                    CLAY_TEXT(CLAY_STRING("Duplicate cards"), CLAY_TEXT_CONFIG({.textColor={100,100,100,255}, .fontSize=18}));
-                    GuiSliderInt(CLAY_ID("duplicateRows"), "Count", &uiState.duplicateCount, 1, 100, &uiState);
-                    GuiTextInput(CLAY_ID("duplicateSourcePath"), "Source Path", uiState.duplicateSourcePath, 256, 3, &uiState.activeTextInput);
-                    GuiTextInput(CLAY_ID("duplicateDestinationPath"), "Destination Path", uiState.duplicateDestinationPath, 256, 4, &uiState.activeTextInput);
-                    if (GuiButton(CLAY_ID("duplicateButton"), "Duplicate")) {
-                        try
-                        {
-                            duplicate_cards(uiState.duplicateSourcePath, uiState.duplicateDestinationPath, uiState.duplicateCount);
-                            snprintf(uiState.statusMessage, sizeof(uiState.statusMessage), "Duplication complete!");
-                            uiState.statusColor = LIME;
-                        } catch (const std::exception& e) {
-                            snprintf(uiState.statusMessage, sizeof(uiState.statusMessage), "Error: %s", e.what());
-                            uiState.statusColor = RED;
-                        }
+                    CLAY_TEXT(CLAY_STRING("Copies"), CLAY_TEXT_CONFIG({.textColor={100,100,100,255}, .fontSize=18}));
+                    GuiSliderInt(CLAY_ID("copiesPerCard"), "Copies per Card", &settings.copiesPerCard, 1, 100, &uiState);
+                    GuiSliderInt(CLAY_ID("memoryBudgetMb"), "Memory Budget MB (0 = no limit)", &settings.memoryBudgetMb, 0, 8192, &uiState);
+                    GuiSliderInt(CLAY_ID("sheetsPerFile"), "Sheets per File (0 = one file)", &settings.sheetsPerFile, 0, 500, &uiState);
+                    GuiSliderInt(CLAY_ID("shardSheets"), "Sheets per Shard (0 = no shards)", &settings.shardSheets, 0, 500, &uiState);
+                }
+
+                // Right Column: Sheet Preview, drawn into previewArea after the layout is rendered
+                CLAY({
+                    .layout = {
+                        .sizing = CLAY_SIZING_GROW(),
+                        .childGap = 15,
+                        .layoutDirection = CLAY_TOP_TO_BOTTOM
+                    }
+                }) {
+                    CLAY_TEXT(CLAY_STRING("Preview"), CLAY_TEXT_CONFIG({.textColor={100,100,100,255}, .fontSize=18}));
+                    CLAY({.layout = {.childGap = 10, .childAlignment = {.y = CLAY_ALIGN_Y_CENTER}}}) {
+                        if (GuiButton(CLAY_ID("previousSheet"), "< Previous")) preview->showSheet(-1);
+                        if (GuiButton(CLAY_ID("nextSheet"), "Next >")) preview->showSheet(1);
+                        CLAY_TEXT(make_clay_string(preview->label()), CLAY_TEXT_CONFIG({.textColor={100,100,100,255}, .fontSize=16}));
                     }
+                    CLAY({
+                        .id = CLAY_ID("previewArea"),
+                        .layout = {.sizing = CLAY_SIZING_GROW()},
+                        .backgroundColor = {230, 230, 230, 255},
+                        .cornerRadius = CLAY_CORNER_RADIUS(5)
+                    }) {}
                 }
             }
 
@@ -527,16 +658,12 @@ int main() {
             // --- Action Buttons & Status ---
             CLAY({.layout={.sizing={.height=CLAY_SIZING_GROW(0)}}}){}; // Spacer to push to bottom
             CLAY({.layout = {.childGap = 20, .childAlignment={.y=CLAY_ALIGN_Y_CENTER} }}) {
-                if (GuiButton(CLAY_ID("generate"), "Generate PDF")) {
-                    try {
-                        CardPDFGenerator generator(settings);
-                        generator.generatePDF(uiState.outputPath, uiState.frontImagesPath, uiState.backImagesPath);
-                        strcpy(uiState.statusMessage, "Success! PDF generated.");
-                        uiState.statusColor = LIME;
-                    } catch (const std::exception& e) {
-                        snprintf(uiState.statusMessage, sizeof(uiState.statusMessage), "Error: %s", e.what());
-                        uiState.statusColor = RED;
+                if (generationJob.running()) {
+                    if (GuiButton(CLAY_ID("cancel"), "Cancel")) {
+                        generationJob.generator->cancel();
                     }
+                } else if (GuiButton(CLAY_ID("generate"), "Generate PDF")) {
+                    StartGeneration(&generationJob, settings, imageStore, &uiState);
                 }
                 if (GuiButton(CLAY_ID("save"), "Save Settings")) {
                     save_settings(settings, "pdf_settings.txt");
@@ -553,10 +680,20 @@ int main() {
         BeginDrawing();
         ClearBackground(RAYWHITE);
         Clay_Raylib_Render(renderCommands, fonts);
+        Clay_ElementData previewArea = Clay_GetElementData(CLAY_ID("previewArea"));
+        if (previewArea.found) {
+            Clay_BoundingBox box = previewArea.boundingBox;
+            preview->draw({box.x + 10, box.y + 10, box.width - 20, box.height - 20});
+        }
         EndDrawing();
     }
 
     // --- Cleanup ---
+    if (generationJob.running()) {
+        generationJob.generator->cancel();
+        generationJob.result.wait();
+    }
+    preview.reset(); // its textures must go before the window
     UnloadFont(fonts[0]);
     Clay_Raylib_Close();
     free(arena.memory);